@@ -0,0 +1,316 @@
+// yabridge: a Wine VST bridge
+// Copyright (C) 2020  Robbert van der Helm
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <sstream>
+#include <thread>
+#include <vector>
+
+#include <boost/asio/io_context.hpp>
+
+#include "../common/communication.h"
+#include "../common/profiling.h"
+#include "../common/serialization.h"
+
+/**
+ * A synthetic benchmark harness for the IPC and serialization layers. This
+ * sets up the exact same `Sockets<std::jthread>` stack `PluginBridge` and
+ * `Vst2Bridge` use, but with both ends living in this process: a fake host
+ * drives the plugin side of the sockets, and a null plugin answers on the
+ * other side. No Wine and no actual plugin are involved, so the numbers
+ * reported here isolate yabridge's own overhead: serialization, the socket
+ * transfer, and the `EventHandler` machinery.
+ *
+ * The harness measures:
+ *
+ * - `dispatch()` round trip latencies for each `EventPayload` alternative
+ * - `getParameter()` storms over the parameter socket
+ * - `processReplacing()` round trips at various channel counts and buffer
+ *   sizes
+ * - concurrent `dispatch()` events, exercising the secondary socket pool
+ *
+ * Latency distributions are collected with the same `LatencyHistogram` used
+ * by the `YABRIDGE_PROFILE` instrumentation. Since these are full round trips
+ * over real Unix domain sockets the absolute numbers depend on the machine
+ * and the scheduler, but relative changes between two builds are meaningful,
+ * which makes this the regression gate for changes to `write_object()`,
+ * `read_object()`, `EventHandler` and the `AudioBuffers` serializer.
+ */
+
+namespace fs = boost::filesystem;
+
+/**
+ * A data converter that sends a preset payload as-is, so every `EventPayload`
+ * alternative can be driven through the real `send_event()` machinery without
+ * needing an actual host or plugin to produce it.
+ */
+class BenchDataConverter : public DefaultDataConverter {
+   public:
+    explicit BenchDataConverter(EventPayload payload)
+        : payload(std::move(payload)) {}
+
+    EventPayload read(const int /*opcode*/,
+                      const int /*index*/,
+                      const intptr_t /*value*/,
+                      const void* /*data*/) const override {
+        return payload;
+    }
+
+    std::optional<EventPayload> read_value(
+        const int /*opcode*/,
+        const intptr_t /*value*/) const override {
+        return std::nullopt;
+    }
+
+    void write(const int /*opcode*/,
+               void* /*data*/,
+               EventResult& /*response*/) const override {}
+
+    void write_value(const int /*opcode*/,
+                     intptr_t /*value*/,
+                     EventResult& /*response*/) const override {}
+
+    intptr_t return_value(const int /*opcode*/,
+                          const intptr_t original) const override {
+        return original;
+    }
+
+   private:
+    EventPayload payload;
+};
+
+/**
+ * Print a single benchmark result: iteration count, throughput, and the
+ * latency distribution in microseconds.
+ */
+void print_result(const std::string& name,
+                  const LatencyHistogram& histogram,
+                  std::chrono::nanoseconds elapsed) {
+    const uint64_t iterations = histogram.count();
+    const double seconds = static_cast<double>(elapsed.count()) / 1e9;
+
+    std::ostringstream result;
+    result << name << ": " << iterations << " iterations, "
+           << static_cast<uint64_t>(static_cast<double>(iterations) / seconds)
+           << "/s, p50/p99/max = " << histogram.percentile(0.50) << "/"
+           << histogram.percentile(0.99) << "/" << histogram.max() << " us";
+    std::cout << result.str() << std::endl;
+}
+
+/**
+ * Time `iterations` runs of a callback, feeding every run's duration into a
+ * histogram, and print the results.
+ */
+template <typename F>
+void run_benchmark(const std::string& name, size_t iterations, F callback) {
+    LatencyHistogram histogram{};
+
+    const auto benchmark_start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < iterations; i++) {
+        const auto iteration_start = std::chrono::steady_clock::now();
+        callback();
+        histogram.record(std::chrono::steady_clock::now() - iteration_start);
+    }
+    const auto elapsed = std::chrono::steady_clock::now() - benchmark_start;
+
+    print_result(name, histogram, elapsed);
+}
+
+int main() {
+    const fs::path base_dir = generate_endpoint_base("bench");
+
+    // The listening (plugin) side has to exist before the connecting (Wine)
+    // side, just like how `PluginBridge` sets up its sockets before launching
+    // the Wine host
+    boost::asio::io_context plugin_context{};
+    boost::asio::io_context host_context{};
+    Sockets<std::jthread> plugin_sockets(plugin_context, base_dir, true);
+    Sockets<std::jthread> host_sockets(host_context, base_dir, false);
+
+    std::jthread connector([&]() { host_sockets.connect(); });
+    plugin_sockets.connect();
+    connector.join();
+
+    // The null plugin: answer every `dispatch()` event with a bare return
+    // value, acknowledge every parameter batch, and echo audio straight back
+    // as if the plugin processed it in place. These loops exit when the
+    // sockets get closed at the end of `main()`.
+    std::jthread dispatch_handler([&]() {
+        host_sockets.host_vst_dispatch.receive_events(
+            std::nullopt, [](Event& /*event*/, bool /*on_main_thread*/) {
+                return EventResult{.return_value = 1,
+                                   .payload = nullptr,
+                                   .value_payload = std::nullopt};
+            });
+    });
+
+    std::jthread parameter_handler([&]() {
+        std::vector<uint8_t> buffer{};
+        ParameterBatchResult result{};
+        try {
+            while (true) {
+                const auto batch =
+                    host_sockets.host_vst_parameters
+                        .receive_single<ParameterBatch>(buffer);
+
+                result.results.clear();
+                for (const Parameter& parameter : batch.parameters) {
+                    // `setParameter()` entries only get acknowledged,
+                    // `getParameter()` queries get a value back
+                    ParameterResult parameter_result{};
+                    if (!parameter.value) {
+                        parameter_result.value = 0.5f;
+                    }
+                    result.results.push_back(parameter_result);
+                }
+
+                host_sockets.host_vst_parameters.send(result, buffer);
+            }
+        } catch (const boost::system::system_error&) {
+        }
+    });
+
+    std::jthread audio_handler([&]() {
+        host_sockets.host_vst_process_replacing.receive_multi<AudioBuffers>(
+            [&](AudioBuffers& buffers, std::vector<uint8_t>& buffer) {
+                buffers.time_info.reset();
+                host_sockets.host_vst_process_replacing.send(buffers, buffer);
+            });
+    });
+
+    std::cout << "Benchmarking the socket stack in " << base_dir.string()
+              << std::endl
+              << std::endl;
+
+    // `dispatch()` round trips for each payload alternative. `ChunkMemfd` is
+    // left out because it requires a real memfd file descriptor, and its
+    // performance is dominated by the memfd writes rather than the socket
+    // layer anyway.
+    DynamicVstEvents midi_events{};
+    midi_events.events.resize(32);
+    DynamicSpeakerArrangement speaker_arrangement{};
+    speaker_arrangement.flags = 0;
+    speaker_arrangement.speakers.resize(8);
+
+    const std::vector<std::pair<std::string, EventPayload>> payloads{
+        {"null", nullptr},
+        {"string", std::string("can't do")},
+        {"4 KB chunk", std::vector<uint8_t>(4096)},
+        {"1 MB chunk", std::vector<uint8_t>(1 << 20)},
+        {"window handle", native_size_t(0xdeadbeef)},
+        {"midi events (32)", midi_events},
+        {"speaker arrangement (8)", speaker_arrangement},
+        {"io properties", VstIOProperties{}},
+        {"midi key name", VstMidiKeyName{}},
+        {"parameter properties", VstParameterProperties{}},
+        {"wants chunk buffer", WantsChunkBuffer{}},
+        {"wants rect", WantsVstRect{}},
+        {"wants time info", WantsVstTimeInfo{}},
+        {"wants string", WantsString{}},
+    };
+    for (const auto& [name, payload] : payloads) {
+        BenchDataConverter converter(payload);
+        run_benchmark("dispatch, " + name, 10'000, [&]() {
+            plugin_sockets.host_vst_dispatch.send_event(
+                converter, std::nullopt, 0, 0, 0, nullptr, 0.0f);
+        });
+    }
+    std::cout << std::endl;
+
+    // `getParameter()` storms: single-query batches, like a host polling a
+    // parameter without the parameter cache
+    {
+        std::vector<uint8_t> buffer{};
+        ParameterBatch batch{};
+        batch.parameters.push_back(Parameter{0, std::nullopt});
+        run_benchmark("getParameter storm", 20'000, [&]() {
+            plugin_sockets.host_vst_parameters.send(batch, buffer);
+            plugin_sockets.host_vst_parameters
+                .receive_single<ParameterBatchResult>(buffer);
+        });
+    }
+    std::cout << std::endl;
+
+    // `processReplacing()` round trips over the socket based audio transport
+    // (the shared memory transport doesn't involve the serializer at all)
+    {
+        std::vector<uint8_t> buffer{};
+        AudioBuffers request{};
+        AudioBuffers response{};
+        for (const int num_channels : {2, 8}) {
+            for (const int sample_frames : {64, 512, 4096}) {
+                std::vector<float>& samples =
+                    request.resize_to<float>(num_channels, sample_frames);
+                std::fill(samples.begin(), samples.end(), 0.5f);
+                request.time_info.reset();
+
+                std::ostringstream name;
+                name << "processReplacing, " << num_channels << " channels, "
+                     << sample_frames << " frames";
+                run_benchmark(name.str(), 5'000, [&]() {
+                    plugin_sockets.host_vst_process_replacing.send(request,
+                                                                   buffer);
+                    plugin_sockets.host_vst_process_replacing.receive_into(
+                        response, buffer);
+                });
+            }
+        }
+    }
+    std::cout << std::endl;
+
+    // Concurrent `dispatch()` events. With four senders the main socket is
+    // almost always busy, so most of these events go through the secondary
+    // socket pool.
+    {
+        constexpr size_t num_threads = 4;
+        constexpr size_t iterations_per_thread = 5'000;
+
+        BenchDataConverter converter(nullptr);
+        LatencyHistogram histogram{};
+
+        const auto benchmark_start = std::chrono::steady_clock::now();
+        {
+            std::vector<std::jthread> senders{};
+            for (size_t thread = 0; thread < num_threads; thread++) {
+                senders.emplace_back([&]() {
+                    for (size_t i = 0; i < iterations_per_thread; i++) {
+                        const auto iteration_start =
+                            std::chrono::steady_clock::now();
+                        plugin_sockets.host_vst_dispatch.send_event(
+                            converter, std::nullopt, 0, 0, 0, nullptr, 0.0f);
+                        histogram.record(std::chrono::steady_clock::now() -
+                                         iteration_start);
+                    }
+                });
+            }
+        }
+        const auto elapsed = std::chrono::steady_clock::now() - benchmark_start;
+
+        std::ostringstream name;
+        name << "concurrent dispatch, " << num_threads << " threads";
+        print_result(name.str(), histogram, elapsed);
+    }
+
+    // Close the sockets the handler threads are blocked on so they shut down,
+    // the same way they would during a regular plugin shutdown
+    host_sockets.host_vst_dispatch.close();
+    host_sockets.host_vst_parameters.close();
+    host_sockets.host_vst_process_replacing.close();
+
+    return 0;
+}
@@ -0,0 +1,261 @@
+// yabridge: a Wine VST bridge
+// Copyright (C) 2020  Robbert van der Helm
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#include "audio-shm.h"
+
+#include <fcntl.h>
+#include <linux/futex.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <cstring>
+#include <system_error>
+
+#include "utils.h"
+
+namespace fs = boost::filesystem;
+
+/**
+ * The initial size of the mapping. A single page is enough for the header, the
+ * first processing call will grow the mapping to fit the actual buffers.
+ */
+constexpr size_t initial_buffer_size = 4096;
+
+/**
+ * A small wrapper around the futex syscall since glibc does not provide one.
+ */
+static long futex(std::atomic<uint32_t>* addr,
+                  int futex_op,
+                  uint32_t val,
+                  const struct timespec* timeout) {
+    return syscall(SYS_futex, reinterpret_cast<uint32_t*>(addr), futex_op, val,
+                   timeout, nullptr, 0);
+}
+
+AudioShmBuffer::AudioShmBuffer(const fs::path& shm_path, bool create)
+    : shm_path(shm_path), is_creator(create) {
+    fd = open(shm_path.c_str(), create ? (O_RDWR | O_CREAT | O_EXCL) : O_RDWR,
+              0600);
+    if (fd == -1) {
+        throw std::system_error(errno, std::system_category(),
+                                "Could not open '" + shm_path.string() + "'");
+    }
+
+    if (create && ftruncate(fd, initial_buffer_size) != 0) {
+        const int ftruncate_errno = errno;
+        close(fd);
+        fs::remove(shm_path);
+        throw std::system_error(ftruncate_errno, std::system_category(),
+                                "Could not resize '" + shm_path.string() +
+                                    "'");
+    }
+
+    if (create) {
+        mapping_size = initial_buffer_size;
+    } else {
+        // The creating side may have already grown the file by the time we map
+        // it, so we'll map whatever is there right now
+        struct stat file_info;
+        if (fstat(fd, &file_info) != 0) {
+            const int fstat_errno = errno;
+            close(fd);
+            throw std::system_error(fstat_errno, std::system_category(),
+                                    "Could not stat '" + shm_path.string() +
+                                        "'");
+        }
+
+        mapping_size = file_info.st_size;
+    }
+
+    mapping = static_cast<uint8_t*>(mmap(nullptr, mapping_size,
+                                         PROT_READ | PROT_WRITE, MAP_SHARED,
+                                         fd, 0));
+    if (mapping == MAP_FAILED) {
+        const int mmap_errno = errno;
+        close(fd);
+        if (create) {
+            fs::remove(shm_path);
+        }
+        throw std::system_error(mmap_errno, std::system_category(),
+                                "Could not map '" + shm_path.string() + "'");
+    }
+
+    if (create) {
+        // The file is zeroed out by `ftruncate()`, but we'll initialize the
+        // header explicitly anyway for clarity's sake
+        new (mapping) Header{};
+        header()->buffer_size = mapping_size;
+    }
+}
+
+AudioShmBuffer::~AudioShmBuffer() {
+    if (mapping) {
+        // Make sure the other side does not stay blocked on a futex forever
+        // when we shut down
+        header()->shutdown.store(1, std::memory_order_release);
+        futex(&header()->request_counter, FUTEX_WAKE, INT32_MAX, nullptr);
+        futex(&header()->response_counter, FUTEX_WAKE, INT32_MAX, nullptr);
+
+        munmap(mapping, mapping_size);
+    }
+    if (fd != -1) {
+        close(fd);
+    }
+
+    // The file itself lives within the socket endpoint base directory, which
+    // gets removed in its entirety by `Sockets`'s destructor, but we'll still
+    // clean up after ourselves in case the destruction order ever changes
+    if (is_creator) {
+        try {
+            fs::remove(shm_path);
+        } catch (const fs::filesystem_error&) {
+            // The entire directory may have already been removed
+        }
+    }
+}
+
+void AudioShmBuffer::resize_to_fit(size_t data_size) {
+    const size_t needed_size = sizeof(Header) + data_size;
+    if (needed_size <= mapping_size) {
+        return;
+    }
+
+    // Grow in larger steps so changing buffer sizes doesn't cause a remap for
+    // every small increase
+    size_t new_size = mapping_size;
+    while (new_size < needed_size) {
+        new_size *= 2;
+    }
+
+    if (ftruncate(fd, new_size) != 0) {
+        throw std::system_error(errno, std::system_category(),
+                                "Could not resize '" + shm_path.string() +
+                                    "'");
+    }
+
+    uint8_t* new_mapping = static_cast<uint8_t*>(
+        mremap(mapping, mapping_size, new_size, MREMAP_MAYMOVE));
+    if (new_mapping == MAP_FAILED) {
+        throw std::system_error(errno, std::system_category(),
+                                "Could not remap '" + shm_path.string() + "'");
+    }
+
+    mapping = new_mapping;
+    mapping_size = new_size;
+    header()->buffer_size = new_size;
+}
+
+void AudioShmBuffer::remap_if_grown() {
+    const size_t current_size = header()->buffer_size;
+    if (current_size == mapping_size) {
+        return;
+    }
+
+    uint8_t* new_mapping = static_cast<uint8_t*>(
+        mremap(mapping, mapping_size, current_size, MREMAP_MAYMOVE));
+    if (new_mapping == MAP_FAILED) {
+        throw std::system_error(errno, std::system_category(),
+                                "Could not remap '" + shm_path.string() + "'");
+    }
+
+    mapping = new_mapping;
+    mapping_size = current_size;
+}
+
+uint8_t* AudioShmBuffer::data() noexcept {
+    return mapping + sizeof(Header);
+}
+
+AudioShmBuffer::Header* AudioShmBuffer::header() noexcept {
+    return reinterpret_cast<Header*>(mapping);
+}
+
+void AudioShmBuffer::set_spin_duration(
+    std::chrono::microseconds duration) noexcept {
+    spin_duration = duration;
+}
+
+void AudioShmBuffer::notify_request() noexcept {
+    header()->request_counter.fetch_add(1, std::memory_order_release);
+    futex(&header()->request_counter, FUTEX_WAKE, 1, nullptr);
+}
+
+void AudioShmBuffer::notify_response() noexcept {
+    header()->response_counter.fetch_add(1, std::memory_order_release);
+    futex(&header()->response_counter, FUTEX_WAKE, 1, nullptr);
+}
+
+std::optional<uint32_t> AudioShmBuffer::wait_for_request(
+    uint32_t last_seen) noexcept {
+    return wait_on_futex(header()->request_counter, last_seen, std::nullopt);
+}
+
+std::optional<uint32_t> AudioShmBuffer::wait_for_response(
+    uint32_t last_seen,
+    std::chrono::milliseconds timeout) noexcept {
+    return wait_on_futex(header()->response_counter, last_seen, timeout);
+}
+
+std::optional<uint32_t> AudioShmBuffer::wait_on_futex(
+    std::atomic<uint32_t>& futex_word,
+    uint32_t last_seen,
+    std::optional<std::chrono::milliseconds> timeout) noexcept {
+    // When the low latency spin mode is enabled we'll first spin for a bit
+    // before doing an actual futex wait, since the other side usually responds
+    // within tens of microseconds and a futex wakeup costs a full scheduler
+    // round trip
+    if (spin_duration.count() > 0) {
+        const auto spin_deadline =
+            std::chrono::steady_clock::now() + spin_duration;
+        while (std::chrono::steady_clock::now() < spin_deadline) {
+            const uint32_t value = futex_word.load(std::memory_order_acquire);
+            if (value != last_seen) {
+                return value;
+            }
+            if (header()->shutdown.load(std::memory_order_acquire) != 0) {
+                return std::nullopt;
+            }
+
+            cpu_pause();
+        }
+    }
+
+    while (true) {
+        const uint32_t value = futex_word.load(std::memory_order_acquire);
+        if (value != last_seen) {
+            return value;
+        }
+        if (header()->shutdown.load(std::memory_order_acquire) != 0) {
+            return std::nullopt;
+        }
+
+        struct timespec timeout_spec;
+        if (timeout) {
+            timeout_spec.tv_sec = timeout->count() / 1000;
+            timeout_spec.tv_nsec = (timeout->count() % 1000) * 1000000;
+        }
+
+        // This can return spuriously or with `EAGAIN` when the counter already
+        // changed, so we'll just always reread the counter
+        const long result = futex(&futex_word, FUTEX_WAIT, last_seen,
+                                  timeout ? &timeout_spec : nullptr);
+        if (result == -1 && errno == ETIMEDOUT) {
+            return std::nullopt;
+        }
+    }
+}
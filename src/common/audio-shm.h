@@ -0,0 +1,236 @@
+// yabridge: a Wine VST bridge
+// Copyright (C) 2020  Robbert van der Helm
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include <vestige/aeffectx.h>
+
+#include <atomic>
+#include <chrono>
+#include <optional>
+
+#ifdef __WINE__
+#include "../wine-host/boost-fix.h"
+#endif
+#include <boost/filesystem.hpp>
+
+/**
+ * The name of the file backing the shared memory audio buffers, relative to
+ * the socket endpoint base directory. This mirrors the naming of the socket it
+ * replaces.
+ */
+constexpr char audio_shm_filename[] = "host_vst_process_replacing.shm";
+
+/**
+ * A shared memory object used to pass audio buffers between the plugin and the
+ * Wine VST host without any serialization. Both sides map the same file
+ * (created within the socket endpoint base directory, which lives on a tmpfs
+ * under `$XDG_RUNTIME_DIR`), and a pair of futexes in the mapping's header is
+ * used as a doorbell to signal that a request or a response is ready. This
+ * replaces the `AudioBuffers` messages sent over the
+ * `host_vst_process_replacing` socket, which involved two serialization passes
+ * and two copies of every audio buffer. The socket remains in use as a fallback
+ * for when the mapping cannot be established on either side.
+ *
+ * The protocol is strictly ping-pong, mirroring the old socket behaviour:
+ *
+ * 1. The plugin writes the input buffers to the mapping, fills in the header
+ *    fields describing the buffers, and then bumps the request futex.
+ * 2. The Wine VST host (which was waiting on the request futex) lets the
+ *    plugin process the audio, writing the results to the output part of the
+ *    mapping, and then bumps the response futex.
+ * 3. The plugin (which was waiting on the response futex) copies the results
+ *    to the host's output arrays.
+ *
+ * Because plugins can change their channel counts at runtime and the host can
+ * use arbitrary buffer sizes, the mapping will be grown on demand by the
+ * creating side. The other side detects this through the `buffer_size` header
+ * field and remaps accordingly. The header itself always lives at the start of
+ * the file and thus never moves.
+ */
+class AudioShmBuffer {
+   public:
+    /**
+     * The header at the start of the shared memory mapping. The atomics are
+     * used as inter-process futexes, so they have to be lock free 32-bit
+     * integers. Everything here uses fixed size types because a 64-bit plugin
+     * may be talking to a 32-bit Wine host when using the bitbridge.
+     */
+    struct alignas(8) Header {
+        /**
+         * Incremented by the plugin after it has written a request to the
+         * buffer. The Wine VST host waits on this futex.
+         */
+        std::atomic<uint32_t> request_counter;
+        /**
+         * Incremented by the Wine VST host after it has written its response.
+         * The plugin waits on this futex.
+         */
+        std::atomic<uint32_t> response_counter;
+        /**
+         * Set to a nonzero value when either side shuts down so the other side
+         * can break out of its futex wait.
+         */
+        std::atomic<uint32_t> shutdown;
+        /**
+         * Whether the current request contains double precision audio sent
+         * through `processDoubleReplacing()` instead of single precision
+         * floats.
+         */
+        uint32_t double_precision;
+        uint32_t num_input_channels;
+        uint32_t num_output_channels;
+        uint32_t sample_frames;
+        /**
+         * Whether `time_info` below contains a valid snapshot for the current
+         * request. Zero when the host does not support `audioMasterGetTime()`.
+         */
+        uint32_t time_info_valid;
+        /**
+         * A snapshot of the host's `VstTimeInfo` taken just before the request
+         * was sent, so the Wine VST host can serve `audioMasterGetTime()`
+         * calls made during the processing call without any IPC. This can be
+         * shared directly between 32-bit and 64-bit processes since
+         * `VstTimeInfo` only contains doubles and 32-bit integers.
+         */
+        VstTimeInfo time_info;
+        /**
+         * The current size of the backing file. When the creating side grows
+         * the file, the other side uses this field to detect that it should
+         * remap.
+         */
+        uint64_t buffer_size;
+    };
+
+    static_assert(std::atomic<uint32_t>::is_always_lock_free);
+
+    /**
+     * Create or open the shared memory object backing the audio buffers.
+     *
+     * @param shm_path The path of the file that will be mapped on both sides.
+     *   This should be a file inside of the socket endpoint base directory.
+     * @param create Whether to create the file. This should be set to `true`
+     *   on the plugin side, and `false` on the Wine host side. The creating
+     *   side will remove the file again when the constructor fails so the
+     *   other side never ends up mapping a partially initialized file.
+     *
+     * @throw std::system_error If the file could not be created, opened or
+     *   mapped. The caller should then fall back to the socket based
+     *   transport.
+     */
+    AudioShmBuffer(const boost::filesystem::path& shm_path, bool create);
+
+    /**
+     * Signal a shutdown to the other side and unmap the buffer.
+     */
+    ~AudioShmBuffer();
+
+    AudioShmBuffer(const AudioShmBuffer&) = delete;
+    AudioShmBuffer& operator=(const AudioShmBuffer&) = delete;
+
+    /**
+     * Grow the backing file and the mapping so it can hold at least
+     * `data_size` bytes of audio data in addition to the header. Only the
+     * creating side should call this. Any pointers into the mapping will be
+     * invalidated when the mapping actually grows.
+     */
+    void resize_to_fit(size_t data_size);
+
+    /**
+     * Remap the buffer if the creating side has grown it since we last mapped
+     * it. Should be called by the non-creating side after receiving a request.
+     */
+    void remap_if_grown();
+
+    /**
+     * A pointer to the start of the audio data, right after the header.
+     */
+    uint8_t* data() noexcept;
+
+    /**
+     * The header at the start of the mapping.
+     */
+    Header* header() noexcept;
+
+    /**
+     * Make the wait functions spin for the given duration before blocking on
+     * the futex. Used when `Configuration::low_latency_spin` is enabled to
+     * skip the scheduler wakeup when the other side responds quickly.
+     */
+    void set_spin_duration(std::chrono::microseconds duration) noexcept;
+
+    /**
+     * Bump the request futex to let the Wine VST host know that a request has
+     * been written to the buffer.
+     */
+    void notify_request() noexcept;
+
+    /**
+     * Bump the response futex to let the plugin know that the response has
+     * been written to the buffer.
+     */
+    void notify_response() noexcept;
+
+    /**
+     * Block until a new request arrives, i.e. until the request counter no
+     * longer matches `last_seen`.
+     *
+     * @return The new value of the request counter, or a nullopt if the other
+     *   side has signalled a shutdown.
+     */
+    std::optional<uint32_t> wait_for_request(uint32_t last_seen) noexcept;
+
+    /**
+     * Block until the response counter no longer matches `last_seen`, with a
+     * timeout so the caller can periodically check whether the other side is
+     * still alive.
+     *
+     * @return The new value of the response counter, a nullopt if the wait
+     *   timed out or if the other side has signalled a shutdown.
+     */
+    std::optional<uint32_t> wait_for_response(
+        uint32_t last_seen,
+        std::chrono::milliseconds timeout) noexcept;
+
+   private:
+    /**
+     * Wait until `futex_word` no longer contains `last_seen`, or until
+     * `timeout` expires when one is given.
+     */
+    std::optional<uint32_t> wait_on_futex(
+        std::atomic<uint32_t>& futex_word,
+        uint32_t last_seen,
+        std::optional<std::chrono::milliseconds> timeout) noexcept;
+
+    boost::filesystem::path shm_path;
+
+    /**
+     * How long to spin before blocking in the wait functions.
+     *
+     * @see AudioShmBuffer::set_spin_duration
+     */
+    std::chrono::microseconds spin_duration{0};
+
+    /**
+     * Whether this side created the file, and is thus responsible for removing
+     * it again and for growing the mapping.
+     */
+    bool is_creator;
+
+    int fd = -1;
+    uint8_t* mapping = nullptr;
+    size_t mapping_size = 0;
+};
@@ -0,0 +1,107 @@
+// yabridge: a Wine VST bridge
+// Copyright (C) 2020  Robbert van der Helm
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+#include <vector>
+
+#include <bitsery/details/serialization_common.h>
+#include <bitsery/traits/core/traits.h>
+#include <bitsery/traits/vector.h>
+
+namespace bitsery {
+namespace ext {
+
+/**
+ * An adapter for serializing vectors of trivially copyable objects as a single
+ * block of bytes instead of element by element. Bitsery's regular container
+ * functions call a serialization function for every element, and with large
+ * MIDI event batches or audio buffers those per-element calls show up in
+ * profiles. Since both sides of the bridge are compiled from the exact same
+ * headers we don't need per-field portability here, so the elements can be
+ * staged into a byte buffer with a single `memcpy()` and then written out
+ * through bitsery's byte container path in one go.
+ *
+ * The staging buffer is thread local so repeatedly (de)serializing large
+ * vectors doesn't allocate. Because of that this extension can't be nested
+ * within itself, which is fine since it's only ever used for leaf fields.
+ */
+class PodVector {
+   public:
+    /**
+     * @param max_size The maximum number of elements in the vector. Like the
+     *   size limits passed to bitsery's own container functions this is only
+     *   used as a sanity check during deserialization.
+     */
+    PodVector(size_t max_size) : max_size(max_size) {}
+
+    template <typename Ser, typename T, typename Fnc>
+    void serialize(Ser& ser, const std::vector<T>& vec, Fnc&&) const {
+        static_assert(std::is_trivially_copyable_v<T>);
+
+        std::vector<uint8_t>& blob = staging_buffer();
+        blob.resize(vec.size() * sizeof(T));
+        if (!blob.empty()) {
+            std::memcpy(blob.data(), vec.data(), blob.size());
+        }
+
+        ser.container1b(blob, max_size * sizeof(T));
+    }
+
+    template <typename Des, typename T, typename Fnc>
+    void deserialize(Des& des, std::vector<T>& vec, Fnc&&) const {
+        static_assert(std::is_trivially_copyable_v<T>);
+
+        std::vector<uint8_t>& blob = staging_buffer();
+        des.container1b(blob, max_size * sizeof(T));
+
+        vec.resize(blob.size() / sizeof(T));
+        if (!blob.empty()) {
+            std::memcpy(vec.data(), blob.data(), blob.size());
+        }
+    }
+
+   private:
+    /**
+     * The scratch buffer the elements get staged into. This only ever grows,
+     * so after the first few blocks no more allocations happen on the threads
+     * that use this extension.
+     */
+    static std::vector<uint8_t>& staging_buffer() {
+        thread_local std::vector<uint8_t> buffer{};
+        return buffer;
+    }
+
+    size_t max_size;
+};
+
+}  // namespace ext
+
+namespace traits {
+
+template <typename T>
+struct ExtensionTraits<ext::PodVector, std::vector<T>> {
+    using TValue = void;
+    static constexpr bool SupportValueOverload = false;
+    static constexpr bool SupportObjectOverload = true;
+    static constexpr bool SupportLambdaOverload = false;
+};
+
+}  // namespace traits
+}  // namespace bitsery
@@ -0,0 +1,192 @@
+// yabridge: a Wine VST bridge
+// Copyright (C) 2020  Robbert van der Helm
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#include "buffer-pool.h"
+
+#include <algorithm>
+#include <bit>
+
+#include "logging.h"
+
+/**
+ * Buffers are never smaller than this. This matches the speculative read in
+ * `read_object_into()`, which always grows its buffer to at least this size.
+ * Using a smaller floor would cause every read to check out a buffer from a
+ * smaller size class than the one it gets returned to, defeating the reuse.
+ */
+constexpr size_t min_buffer_size = 1024;
+
+/**
+ * The smallest size class, i.e. the class `min_buffer_size` maps to.
+ */
+constexpr size_t min_size_class = std::bit_width(min_buffer_size - 1);
+
+/**
+ * Map a requested capacity to the smallest size class that can hold it.
+ */
+static size_t size_class_for(size_t capacity) {
+    const size_t size_class =
+        std::bit_width(std::max(capacity, min_buffer_size) - 1);
+
+    return std::min(size_class, BufferPool::num_size_classes - 1);
+}
+
+BufferPool& BufferPool::instance() {
+    // Deliberately leaked. Objects can still be serialized while static
+    // objects are being destroyed during shutdown, so the pool has to outlive
+    // everything else.
+    static BufferPool& pool = *new BufferPool();
+
+    return pool;
+}
+
+std::vector<uint8_t> BufferPool::borrow(size_t initial_capacity) {
+    const auto now = std::chrono::steady_clock::now();
+    const size_t wanted_class = size_class_for(initial_capacity);
+
+    // Buffers freed during the trim get deallocated after the lock has been
+    // released again
+    std::vector<std::vector<uint8_t>> freed{};
+    std::vector<uint8_t> buffer{};
+    size_t new_ceiling = 0;
+    {
+        std::lock_guard lock(mutex);
+        trim_stale_classes(now, freed);
+
+        size_classes[wanted_class].last_borrow = now;
+
+        // Prefer a cached buffer from the requested size class, but a
+        // slightly larger one also does the job and saves an allocation
+        for (size_t size_class = wanted_class;
+             size_class < std::min(wanted_class + 3, num_size_classes);
+             size_class++) {
+            auto& cached = size_classes[size_class].buffers;
+            if (!cached.empty()) {
+                buffer = std::move(cached.back());
+                cached.pop_back();
+                cached_bytes -= buffer.capacity();
+                break;
+            }
+        }
+
+        // Round fresh buffers up to their class's upper bound so they end up
+        // in that same class when they're returned again
+        if (buffer.capacity() == 0) {
+            buffer.reserve(static_cast<size_t>(1) << wanted_class);
+        }
+
+        outstanding_bytes += buffer.capacity();
+        new_ceiling = update_peak();
+    }
+
+    if (new_ceiling > 0) {
+        Logger logger = Logger::create_from_environment();
+        logger.log("Serialization buffers for this process peaked at " +
+                   std::to_string(new_ceiling / (1 << 20)) + " MB");
+    }
+
+    return buffer;
+}
+
+void BufferPool::give_back(std::vector<uint8_t> buffer,
+                           size_t borrowed_capacity) {
+    const auto now = std::chrono::steady_clock::now();
+    buffer.clear();
+
+    std::vector<std::vector<uint8_t>> freed{};
+    size_t new_ceiling = 0;
+    {
+        std::lock_guard lock(mutex);
+
+        // The buffer may have grown while it was checked out, so the peak has
+        // to be updated with that growth before the buffer gets subtracted
+        // from the outstanding total again
+        outstanding_bytes += buffer.capacity() - borrowed_capacity;
+        new_ceiling = update_peak();
+        outstanding_bytes -= buffer.capacity();
+
+        // Classify by the largest power of two that fits within the capacity,
+        // so the cached buffer can satisfy any request up to that size without
+        // reallocating
+        const size_t size_class =
+            std::clamp(static_cast<size_t>(std::bit_width(buffer.capacity())) -
+                           1,
+                       min_size_class, num_size_classes - 1);
+        auto& cached = size_classes[size_class].buffers;
+        if (cached.size() < max_cached_buffers_per_class) {
+            cached_bytes += buffer.capacity();
+            cached.push_back(std::move(buffer));
+        } else {
+            freed.push_back(std::move(buffer));
+        }
+
+        trim_stale_classes(now, freed);
+    }
+
+    if (new_ceiling > 0) {
+        Logger logger = Logger::create_from_environment();
+        logger.log("Serialization buffers for this process peaked at " +
+                   std::to_string(new_ceiling / (1 << 20)) + " MB");
+    }
+}
+
+void BufferPool::trim_stale_classes(
+    std::chrono::steady_clock::time_point now,
+    std::vector<std::vector<uint8_t>>& freed) {
+    // Scanning all classes on every single checkout would be wasteful, and
+    // with a ten second decay there's no need to be any more precise than this
+    if (now - last_trim < std::chrono::seconds(1)) {
+        return;
+    }
+    last_trim = now;
+
+    for (size_t size_class = 0; size_class < num_size_classes; size_class++) {
+        if ((static_cast<size_t>(1) << size_class) < trim_threshold) {
+            continue;
+        }
+
+        SizeClass& stale_class = size_classes[size_class];
+        if (stale_class.buffers.empty() ||
+            now - stale_class.last_borrow < decay_timeout) {
+            continue;
+        }
+
+        for (auto& buffer : stale_class.buffers) {
+            cached_bytes -= buffer.capacity();
+            freed.push_back(std::move(buffer));
+        }
+        stale_class.buffers.clear();
+    }
+}
+
+size_t BufferPool::update_peak() {
+    const size_t total_bytes = cached_bytes + outstanding_bytes;
+    if (total_bytes <= peak_bytes) {
+        return 0;
+    }
+    peak_bytes = total_bytes;
+
+    // Only report ceilings of a megabyte and up, and only when the previous
+    // report has been doubled so the log doesn't fill up with updates
+    constexpr size_t reporting_threshold = 1 << 20;
+    if (peak_bytes >= reporting_threshold &&
+        peak_bytes >= reported_peak_bytes * 2) {
+        reported_peak_bytes = peak_bytes;
+        return peak_bytes;
+    }
+
+    return 0;
+}
@@ -0,0 +1,185 @@
+// yabridge: a Wine VST bridge
+// Copyright (C) 2020  Robbert van der Helm
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+/**
+ * A process wide pool of serialization buffers, used by `read_object()` and
+ * `write_object()` through the `PooledBuffer` wrapper defined below.
+ *
+ * Without pooling every socket loop grows its own `std::vector<uint8_t>` to
+ * the largest message it has ever seen and then keeps it around for the rest
+ * of the session. A single project save that transfers a large preset chunk
+ * would thus pin tens of megabytes per plugin instance, and with a many
+ * instances loaded that adds up to gigabytes of idle resident memory. With
+ * the pool those oversized buffers get returned after every message, reused
+ * whenever a message of a similar size comes along, and freed again once
+ * they've gone unused for a while.
+ *
+ * Buffers are kept in size classes based on their capacity rounded down to a
+ * power of two, so a checkout can be satisfied with a simple move instead of
+ * an allocation whenever a buffer of a similar size was recently returned.
+ */
+class BufferPool {
+   public:
+    /**
+     * Fetch the pool for this process.
+     */
+    static BufferPool& instance();
+
+    /**
+     * Check out a buffer with at least the given capacity. The buffer will
+     * have a size of zero. Prefer using `PooledBuffer` over calling this
+     * directly so the buffer always finds its way back to the pool.
+     *
+     * @param initial_capacity A hint for the expected message size, rounded
+     *   up to the pool's minimum buffer size. Passing the size of the
+     *   previous message on the same socket avoids having to grow the buffer
+     *   again for recurring messages such as audio buffers.
+     */
+    std::vector<uint8_t> borrow(size_t initial_capacity);
+
+    /**
+     * Return a buffer to the pool. The buffer may have grown beyond the
+     * capacity it was checked out with, which is how large transfers end up
+     * in the larger size classes in the first place.
+     *
+     * @param buffer The buffer that was checked out earlier.
+     * @param borrowed_capacity The buffer's capacity at the time `borrow()`
+     *   returned it, used for the memory ceiling bookkeeping.
+     */
+    void give_back(std::vector<uint8_t> buffer, size_t borrowed_capacity);
+
+    /**
+     * One size class per power of two, which is plenty since
+     * `binary_buffer_size` caps messages at 50 MB anyway.
+     */
+    static constexpr size_t num_size_classes = 32;
+
+    /**
+     * The number of buffers kept around per size class. With the secondary
+     * socket pool capped at eight concurrent requests there's no point in
+     * caching more than that.
+     */
+    static constexpr size_t max_cached_buffers_per_class = 8;
+
+    /**
+     * Size classes smaller than this are never trimmed. Freeing and
+     * reallocating kilobyte sized buffers would cost more than it saves.
+     */
+    static constexpr size_t trim_threshold = 1 << 16;
+
+    /**
+     * Cached buffers in a large size class get freed when nothing has been
+     * checked out from that class for this long. This is what makes a
+     * transient 50 MB chunk transfer only a transient memory spike.
+     */
+    static constexpr std::chrono::seconds decay_timeout{10};
+
+   private:
+    BufferPool() noexcept = default;
+
+    struct SizeClass {
+        /**
+         * Returned buffers that can be checked out again, most recently
+         * returned last.
+         */
+        std::vector<std::vector<uint8_t>> buffers;
+
+        /**
+         * The last time a buffer was checked out from this class, used for
+         * the decay described in `decay_timeout`.
+         */
+        std::chrono::steady_clock::time_point last_borrow{};
+    };
+
+    /**
+     * Free cached buffers in size classes that haven't been borrowed from
+     * recently, moving them into `freed` so the actual deallocation can
+     * happen outside of the lock. Runs at most once per second.
+     */
+    void trim_stale_classes(std::chrono::steady_clock::time_point now,
+                            std::vector<std::vector<uint8_t>>& freed);
+
+    /**
+     * Update `peak_bytes` after `cached_bytes` or `outstanding_bytes` has
+     * changed, and report new memory ceilings through the logger. Returns the
+     * new ceiling in bytes when it should be reported, or zero otherwise. The
+     * actual logging has to be done by the caller after releasing the lock.
+     */
+    size_t update_peak();
+
+    std::mutex mutex;
+    std::array<SizeClass, num_size_classes> size_classes;
+
+    /**
+     * The last time `trim_stale_classes()` did an actual scan.
+     */
+    std::chrono::steady_clock::time_point last_trim{};
+
+    /**
+     * The total capacity of all buffers currently cached in the pool.
+     */
+    size_t cached_bytes = 0;
+    /**
+     * The total capacity of all buffers currently checked out, as measured
+     * when they were borrowed.
+     */
+    size_t outstanding_bytes = 0;
+    /**
+     * The high water mark of `cached_bytes + outstanding_bytes`. This is the
+     * memory ceiling for this process's serialization buffers.
+     */
+    size_t peak_bytes = 0;
+    /**
+     * The last ceiling that was written to the log. A new message only gets
+     * logged when the peak doubles to avoid spamming the log.
+     */
+    size_t reported_peak_bytes = 0;
+};
+
+/**
+ * A RAII wrapper around a buffer checked out from `BufferPool`, for use with
+ * `read_object()` and `write_object()`. The buffer gets returned to the pool
+ * when this object goes out of scope.
+ */
+class PooledBuffer {
+   public:
+    explicit PooledBuffer(size_t initial_capacity = 0)
+        : buffer(BufferPool::instance().borrow(initial_capacity)),
+          borrowed_capacity(buffer.capacity()) {}
+
+    ~PooledBuffer() {
+        BufferPool::instance().give_back(std::move(buffer), borrowed_capacity);
+    }
+
+    PooledBuffer(const PooledBuffer&) = delete;
+    PooledBuffer& operator=(const PooledBuffer&) = delete;
+    PooledBuffer(PooledBuffer&&) = delete;
+    PooledBuffer& operator=(PooledBuffer&&) = delete;
+
+    std::vector<uint8_t>& get() noexcept { return buffer; }
+
+   private:
+    std::vector<uint8_t> buffer;
+    size_t borrowed_capacity;
+};
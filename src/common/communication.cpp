@@ -56,7 +56,7 @@ std::optional<EventPayload> DefaultDataConverter::read_value(
 
 void DefaultDataConverter::write(const int /*opcode*/,
                                  void* data,
-                                 const EventResult& response) const {
+                                 EventResult& response) const {
     // The default behavior is to handle this as a null terminated C-style
     // string
     std::visit(overload{[&](const auto&) {},
@@ -74,7 +74,7 @@ void DefaultDataConverter::write(const int /*opcode*/,
 
 void DefaultDataConverter::write_value(const int /*opcode*/,
                                        intptr_t /*value*/,
-                                       const EventResult& /*response*/) const {}
+                                       EventResult& /*response*/) const {}
 
 intptr_t DefaultDataConverter::return_value(const int /*opcode*/,
                                             const intptr_t original) const {
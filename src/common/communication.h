@@ -16,7 +16,16 @@
 
 #pragma once
 
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <array>
 #include <atomic>
+#include <cerrno>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <mutex>
 
 #include <bitsery/adapter/buffer.h>
 #include <bitsery/bitsery.h>
@@ -30,7 +39,10 @@
 #include <boost/asio/write.hpp>
 #include <boost/filesystem.hpp>
 
+#include "buffer-pool.h"
 #include "logging.h"
+#include "profiling.h"
+#include "utils.h"
 
 template <typename B>
 using OutputAdapter = bitsery::OutputBufferAdapter<B>;
@@ -62,67 +74,103 @@ inline void write_object(Socket& socket,
             buffer, object);
 
     // Tell the other side how large the object is so it can prepare a buffer
-    // large enough before sending the data
+    // large enough before sending the data. The header and the payload are
+    // sent in a single vectored write so every message costs only one syscall
+    // instead of two.
     // NOTE: We're writing these sizes as a 64 bit integers, **not** as pointer
     //       sized integers. This is to provide compatibility with the 32-bit
     //       bit bridge. This won't make any function difference aside from the
     //       32-bit host application having to convert between 64 and 32 bit
     //       integers.
-    boost::asio::write(socket,
-                       boost::asio::buffer(std::array<uint64_t, 1>{size}));
-    const size_t bytes_written =
-        boost::asio::write(socket, boost::asio::buffer(buffer, size));
-    assert(bytes_written == size);
+    const std::array<uint64_t, 1> message_length{size};
+    const std::array<boost::asio::const_buffer, 2> buffers{
+        boost::asio::buffer(message_length), boost::asio::buffer(buffer, size)};
+    const size_t bytes_written = boost::asio::write(socket, buffers);
+    assert(bytes_written == sizeof(uint64_t) + size);
 }
 
 /**
- * `write_object()` with a small default buffer for convenience.
+ * `write_object()` with a buffer checked out from the shared pool for
+ * convenience. Since serialized objects can occasionally be huge (think large
+ * preset chunks), pooling these buffers prevents every call site from holding
+ * on to its own copy of the largest message it has ever seen.
  *
  * @overload
  */
 template <typename T, typename Socket>
 inline void write_object(Socket& socket, const T& object) {
-    std::vector<uint8_t> buffer(64);
-    write_object(socket, object, buffer);
+    PooledBuffer buffer{};
+    write_object(socket, object, buffer.get());
 }
 
 /**
- * Deserialize an object by reading it from a socket. This should be used
- * together with `write_object`. This will block until the object is available.
+ * Deserialize an object by reading it from a socket into an existing object.
+ * This is mostly useful for objects that deserialize into borrowed buffers,
+ * such as `AudioBuffersOutput`, since those have to be set up by the caller
+ * before deserializing. This will block until the object is available.
  *
  * @param socket The Boost.Asio socket to read from.
+ * @param object The object to deserialize into.
  * @param buffer The buffer to read into. This is useful for sending audio and
  *   chunk data since that can vary in size by a lot.
  *
- * @return The deserialized object.
+ * @return A reference to `object`.
  *
  * @throw std::runtime_error If the conversion to an object was not successful.
  * @throw boost::system::system_error If the socket is closed or gets closed
  *   while reading.
  *
  * @relates write_object
+ * @relates read_object
  */
 template <typename T, typename Socket>
-inline T read_object(Socket& socket, std::vector<uint8_t>& buffer) {
-    // See the note above on the use of `uint64_t` instead of `size_t`
-    std::array<uint64_t, 1> message_length;
-    boost::asio::read(socket, boost::asio::buffer(message_length));
+inline T& read_object_into(Socket& socket,
+                           T& object,
+                           std::vector<uint8_t>& buffer) {
+    // The writing side sends the 8-byte length header and the payload in a
+    // single vectored write, so we'll also read them speculatively in a single
+    // `read_some()` call. This is safe because every socket operates in strict
+    // lockstep request-response fashion, so there can never be a second
+    // message queued up behind the one we're reading. Small messages thus cost
+    // a single syscall, and for large messages we read whatever is left after
+    // the buffer has been resized.
+    // See the note in `write_object()` on the use of `uint64_t` instead of
+    // `size_t`.
+    constexpr size_t header_size = sizeof(uint64_t);
+    if (buffer.size() < 1024) {
+        buffer.resize(1024);
+    }
 
-    // Make sure the buffer is large enough
-    const size_t size = message_length[0];
-    buffer.resize(size);
+    size_t bytes_read = 0;
+    while (bytes_read < header_size) {
+        bytes_read += socket.read_some(boost::asio::buffer(
+            buffer.data() + bytes_read, buffer.size() - bytes_read));
+    }
+
+    uint64_t message_length;
+    std::memcpy(&message_length, buffer.data(), header_size);
+
+    // Make sure the buffer is large enough. Since `resize()` keeps the
+    // already read data intact we can read the remainder right behind it.
+    const size_t size = message_length;
+    const size_t total_size = header_size + size;
+    assert(bytes_read <= total_size);
+    if (buffer.size() < total_size) {
+        buffer.resize(total_size);
+    }
 
     // `boost::asio::read/write` will handle all the packet splitting and
     // merging for us, since local domain sockets have packet limits somewhere
     // in the hundreds of kilobytes
-    const auto actual_size =
-        boost::asio::read(socket, boost::asio::buffer(buffer));
-    assert(size == actual_size);
+    if (bytes_read < total_size) {
+        boost::asio::read(
+            socket, boost::asio::buffer(buffer.data() + bytes_read,
+                                        total_size - bytes_read));
+    }
 
-    T object;
     auto [_, success] =
         bitsery::quickDeserialization<InputAdapter<std::vector<uint8_t>>>(
-            {buffer.begin(), size}, object);
+            {buffer.begin() + header_size, size}, object);
 
     if (BOOST_UNLIKELY(!success)) {
         throw std::runtime_error("Deserialization failure in call: " +
@@ -133,14 +181,131 @@ inline T read_object(Socket& socket, std::vector<uint8_t>& buffer) {
 }
 
 /**
- * `read_object()` with a small default buffer for convenience.
+ * Deserialize an object by reading it from a socket. This should be used
+ * together with `write_object`. This will block until the object is available.
+ *
+ * @param socket The Boost.Asio socket to read from.
+ * @param buffer The buffer to read into. This is useful for sending audio and
+ *   chunk data since that can vary in size by a lot.
+ *
+ * @return The deserialized object.
+ *
+ * @throw std::runtime_error If the conversion to an object was not successful.
+ * @throw boost::system::system_error If the socket is closed or gets closed
+ *   while reading.
+ *
+ * @relates write_object
+ */
+template <typename T, typename Socket>
+inline T read_object(Socket& socket, std::vector<uint8_t>& buffer) {
+    T object;
+    read_object_into(socket, object, buffer);
+
+    return object;
+}
+
+/**
+ * `read_object()` with a buffer checked out from the shared pool for
+ * convenience, see the note in the corresponding `write_object()` overload.
  *
  * @overload
  */
 template <typename T, typename Socket>
 inline T read_object(Socket& socket) {
-    std::vector<uint8_t> buffer(64);
-    return read_object<T>(socket, buffer);
+    PooledBuffer buffer{};
+    return read_object<T>(socket, buffer.get());
+}
+
+/**
+ * Pass a file descriptor over a Unix domain socket using `SCM_RIGHTS`
+ * ancillary data attached to a single dummy byte. Used to transfer the memfds
+ * backing large preset chunks, see `ChunkMemfd`. This should be called right
+ * after writing the message announcing the descriptor, and the other side
+ * should call `receive_fd()` right after deserializing that message. The
+ * kernel never merges the ancillary carrying byte into a preceding read, so
+ * the speculative reads in `read_object_into()` cannot swallow it.
+ *
+ * @throw boost::system::system_error If the socket is closed or gets closed
+ *   while sending.
+ *
+ * @relates receive_fd
+ */
+inline void send_fd(boost::asio::local::stream_protocol::socket& socket,
+                    int fd) {
+    uint8_t dummy = 0;
+    alignas(cmsghdr) std::array<uint8_t, CMSG_SPACE(sizeof(int))>
+        control_buffer{};
+
+    iovec iov{.iov_base = &dummy, .iov_len = sizeof(dummy)};
+    msghdr message{};
+    message.msg_iov = &iov;
+    message.msg_iovlen = 1;
+    message.msg_control = control_buffer.data();
+    message.msg_controllen = control_buffer.size();
+
+    cmsghdr* cmsg = CMSG_FIRSTHDR(&message);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+    std::memcpy(CMSG_DATA(cmsg), &fd, sizeof(int));
+
+    ssize_t result;
+    do {
+        // Boost.Asio may have put the underlying socket in non-blocking mode,
+        // so we'll explicitly wait for writability before trying again
+        socket.wait(boost::asio::local::stream_protocol::socket::wait_write);
+        result = sendmsg(socket.native_handle(), &message, 0);
+    } while (result == -1 &&
+             (errno == EINTR || errno == EAGAIN || errno == EWOULDBLOCK));
+    if (result == -1) {
+        throw boost::system::system_error(boost::system::error_code(
+            errno, boost::system::generic_category()));
+    }
+}
+
+/**
+ * The receiving counterpart to `send_fd()`. Returns the received descriptor,
+ * or -1 when the message did not carry one (which would indicate that the
+ * other side failed to send it).
+ *
+ * @throw boost::system::system_error If the socket is closed or gets closed
+ *   while receiving.
+ *
+ * @relates send_fd
+ */
+inline int receive_fd(boost::asio::local::stream_protocol::socket& socket) {
+    uint8_t dummy;
+    alignas(cmsghdr) std::array<uint8_t, CMSG_SPACE(sizeof(int))>
+        control_buffer{};
+
+    iovec iov{.iov_base = &dummy, .iov_len = sizeof(dummy)};
+    msghdr message{};
+    message.msg_iov = &iov;
+    message.msg_iovlen = 1;
+    message.msg_control = control_buffer.data();
+    message.msg_controllen = control_buffer.size();
+
+    ssize_t result;
+    do {
+        socket.wait(boost::asio::local::stream_protocol::socket::wait_read);
+        result = recvmsg(socket.native_handle(), &message, MSG_CMSG_CLOEXEC);
+    } while (result == -1 &&
+             (errno == EINTR || errno == EAGAIN || errno == EWOULDBLOCK));
+    if (result <= 0) {
+        throw boost::system::system_error(boost::system::error_code(
+            errno, boost::system::generic_category()));
+    }
+
+    const cmsghdr* cmsg = CMSG_FIRSTHDR(&message);
+    if (!cmsg || cmsg->cmsg_level != SOL_SOCKET ||
+        cmsg->cmsg_type != SCM_RIGHTS) {
+        return -1;
+    }
+
+    int fd;
+    std::memcpy(&fd, CMSG_DATA(cmsg), sizeof(int));
+
+    return fd;
 }
 
 /**
@@ -184,6 +349,16 @@ class SocketHandler {
         }
     }
 
+    /**
+     * Take over an already established connection instead of accepting or
+     * connecting one in `connect()`. Used by `Sockets::connect()` when all
+     * channels share a single socket endpoint.
+     */
+    void adopt_connection(
+        boost::asio::local::stream_protocol::socket established_socket) {
+        socket = std::move(established_socket);
+    }
+
     /**
      * Close the socket. Both sides that are actively listening will be thrown a
      * `boost::system_error` when this happens.
@@ -250,9 +425,42 @@ class SocketHandler {
      */
     template <typename T>
     inline T receive_single(std::vector<uint8_t>& buffer) {
+        spin_until_readable();
         return read_object<T>(socket, buffer);
     }
 
+    /**
+     * Make the receiving functions spin for the given duration before doing a
+     * blocking read. This is used on the audio processing socket when
+     * `Configuration::low_latency_spin` is enabled so the reading thread can
+     * skip the scheduler wakeup when the other side responds quickly, which it
+     * usually does.
+     */
+    void set_spin_duration(std::chrono::microseconds duration) {
+        spin_duration = duration;
+    }
+
+    /**
+     * The same as `SocketHandler::receive_single()`, but deserializing into an
+     * existing object. Used for objects such as `AudioBuffersOutput` that
+     * write directly into borrowed buffers during their deserialization.
+     *
+     * @param object The object to deserialize into.
+     * @param buffer The buffer to read into. This is used to prevent excess
+     *   allocations when sending audio.
+     *
+     * @return A reference to `object`.
+     *
+     * @relates SocketHandler::receive_single
+     *
+     * @see read_object_into
+     */
+    template <typename T>
+    inline T& receive_into(T& object, std::vector<uint8_t>& buffer) {
+        spin_until_readable();
+        return read_object_into(socket, object, buffer);
+    }
+
     /**
      * `SocketHandler::receive_single()` with a small default buffer for
      * convenience.
@@ -261,6 +469,7 @@ class SocketHandler {
      */
     template <typename T>
     inline T receive_single() {
+        spin_until_readable();
         return read_object<T>(socket);
     }
 
@@ -272,10 +481,10 @@ class SocketHandler {
      *   we'd probably want to do some more stuff after sending a reply, calling
      *   `send()` is the responsibility of this function.
      *
-     * @tparam F A function type in the form of `void(T, std::vector<uint8_t>&)`
-     *   that does something with the object, and then calls `send()`. The
-     *   reading/writing buffer is passed along so it can be reused for sending
-     *   large amounts of data.
+     * @tparam F A function type in the form of
+     *   `void(T&, std::vector<uint8_t>&)` that does something with the object,
+     *   and then calls `send()`. The reading/writing buffer is passed along so
+     *   it can be reused for sending large amounts of data.
      *
      * @relates SocketHandler::send
      *
@@ -284,12 +493,23 @@ class SocketHandler {
      */
     template <typename T, typename F>
     void receive_multi(F callback) {
-        std::vector<uint8_t> buffer{};
+        // The object is deserialized into over and over again so that buffers
+        // allocated for a previous message, such as `AudioBuffers`' audio
+        // data, can be reused for the next one. The serialization buffer gets
+        // checked out from the shared pool per message, sized after the
+        // previous message so recurring messages keep hitting the same size
+        // class. Compared to a buffer that's local to this loop, a single
+        // oversized transfer no longer pins this loop's memory usage at that
+        // size for the rest of the session.
+        T object;
+        size_t previous_message_size = 0;
         while (true) {
             try {
-                auto object = receive_single<T>(buffer);
+                PooledBuffer buffer(previous_message_size);
+                receive_into(object, buffer.get());
+                previous_message_size = buffer.get().size();
 
-                callback(std::move(object), buffer);
+                callback(object, buffer.get());
             } catch (const boost::system::system_error&) {
                 // This happens when the sockets got closed because the plugin
                 // is being shut down
@@ -299,6 +519,34 @@ class SocketHandler {
     }
 
    private:
+    /**
+     * Spin until there is data available on the socket or until
+     * `spin_duration` has expired, whichever comes first. A no-op when the
+     * spin duration has been left at zero.
+     *
+     * @see SocketHandler::set_spin_duration
+     */
+    void spin_until_readable() {
+        if (spin_duration.count() == 0) {
+            return;
+        }
+
+        const auto spin_deadline =
+            std::chrono::steady_clock::now() + spin_duration;
+        boost::system::error_code err;
+        while (std::chrono::steady_clock::now() < spin_deadline) {
+            // The `available()` check is an `ioctl()` call, so this spin is a
+            // lot coarser than the futex based one in `AudioShmBuffer`, but
+            // it's still much cheaper than being scheduled out and woken up
+            // again
+            if (socket.available(err) > 0 || err) {
+                return;
+            }
+
+            cpu_pause();
+        }
+    }
+
     boost::asio::local::stream_protocol::endpoint endpoint;
     boost::asio::local::stream_protocol::socket socket;
 
@@ -307,6 +555,13 @@ class SocketHandler {
      * connection.
      */
     std::optional<boost::asio::local::stream_protocol::acceptor> acceptor;
+
+    /**
+     * How long to spin before blocking in the receiving functions.
+     *
+     * @see SocketHandler::set_spin_duration
+     */
+    std::chrono::microseconds spin_duration{0};
 };
 
 /**
@@ -337,11 +592,14 @@ class DefaultDataConverter {
                                                    const intptr_t value) const;
 
     /**
-     * Write the reponse back to the `data` pointer.
+     * Write the reponse back to the `data` pointer. The response is passed by
+     * mutable reference so large payloads, like the chunk data for
+     * `effGetChunk`, can be moved out of the response instead of being copied
+     * yet another time.
      */
     virtual void write(const int opcode,
                        void* data,
-                       const EventResult& response) const;
+                       EventResult& response) const;
 
     /**
      * Write the reponse back to the `value` pointer. This is only used during
@@ -349,7 +607,7 @@ class DefaultDataConverter {
      */
     virtual void write_value(const int opcode,
                              intptr_t value,
-                             const EventResult& response) const;
+                             EventResult& response) const;
 
     /**
      * This function can override a callback's return value based on the opcode.
@@ -364,6 +622,14 @@ class DefaultDataConverter {
                                   const intptr_t original) const;
 };
 
+/**
+ * The maximum number of idle secondary socket connections `EventHandler` will
+ * keep around for reuse. Any connections returned while the pool is already
+ * this large get closed instead. Even plugins with very chatty editors rarely
+ * have more than a couple of simultaneous events in flight.
+ */
+constexpr size_t max_pooled_secondary_sockets = 8;
+
 /**
  * So, this is a bit of a mess. The TL;DR is that we want to use a single long
  * living socket connection for `dispatch()` and another one for `audioMaster()`
@@ -377,19 +643,23 @@ class DefaultDataConverter {
  * threads, and `audioMaster()` and `dispatch()` calls can even be mutually
  * recursive. Luckily this does not happen very often, but it does mean that our
  * simple 'one-socket-per-function' model doesn't work anymore. Because setting
- * up new sockets is quite expensive and this is seldom needed, this works
- * slightly differently:
+ * up new sockets is quite expensive, this works slightly differently:
  *
  * - We'll keep a single long lived socket connection. This works the exact same
  *   way as every other socket defined in the `Sockets` class.
  * - Aside from that the listening side will have a second thread asynchronously
  *   listening for new connections on the socket endpoint.
+ * - Secondary connections made this way are kept in a small pool on the
+ *   sending side once their request finishes, so with a GUI open during
+ *   playback the contended path only has to pay the connection setup cost the
+ *   first few times.
  *
  * The `EventHandler::send_event()` method is used to send events. If the socket
- * is currently being written to, we'll first create a new socket connection as
- * described above. Similarly, the `EventHandler::receive_events()` method first
- * sets up asynchronous listeners for the socket endpoint, and then block and
- * handle events until the main socket is closed.
+ * is currently being written to, we'll reuse a secondary socket connection
+ * from the pool, connecting a new one if the pool is empty. Similarly, the
+ * `EventHandler::receive_events()` method first sets up asynchronous listeners
+ * for the socket endpoint, and then block and handle events until the main
+ * socket is closed.
  *
  * @tparam Thread The thread implementation to use. On the Linux side this
  *   should be `std::jthread` and on the Wine side this should be `Win32Thread`.
@@ -442,6 +712,19 @@ class EventHandler {
         }
     }
 
+    /**
+     * Take over an already established connection instead of accepting or
+     * connecting one in `connect()`. Used by `Sockets::connect()` when all
+     * channels share a single socket endpoint. The endpoint passed to the
+     * constructor is still used for the secondary connections made in
+     * `send_event()` and `receive_events()`, just like in the multi-endpoint
+     * mode.
+     */
+    void adopt_connection(
+        boost::asio::local::stream_protocol::socket established_socket) {
+        socket = std::move(established_socket);
+    }
+
     /**
      * Close the socket. Both sides that are actively listening will be thrown a
      * `boost::system_error` when this happens.
@@ -452,6 +735,17 @@ class EventHandler {
         socket.shutdown(
             boost::asio::local::stream_protocol::socket::shutdown_both, err);
         socket.close();
+
+        // Idle pooled secondary connections also have to be shut down so the
+        // threads serving them on the other side can exit
+        std::lock_guard pool_lock(secondary_socket_pool_mutex);
+        for (auto& pooled_socket : secondary_socket_pool) {
+            pooled_socket.shutdown(
+                boost::asio::local::stream_protocol::socket::shutdown_both,
+                err);
+            pooled_socket.close(err);
+        }
+        secondary_socket_pool.clear();
     }
 
     /**
@@ -461,8 +755,8 @@ class EventHandler {
      * for details on the parameters and return value of this function.
      *
      * As described above, if this function is currently being called from
-     * another thread, then this will create a new socket connection and send
-     * the event there instead.
+     * another thread, then this will send the event over a pooled secondary
+     * socket connection instead.
      *
      * @param data_converter Some struct that knows how to read data from and
      *   write data back to the `data` void pointer. For host callbacks this
@@ -485,6 +779,14 @@ class EventHandler {
                         intptr_t value,
                         void* data,
                         float option) {
+        // When profiling is enabled we'll time the phases of this round trip
+        // and feed them to per-opcode latency histograms, see `EventProfiler`
+        EventProfiler* const profiler = EventProfiler::instance();
+        std::chrono::steady_clock::time_point profile_start{};
+        if (profiler) {
+            profile_start = std::chrono::steady_clock::now();
+        }
+
         // Encode the right payload types for this event. Check the
         // documentation for `EventPayload` for more information. These types
         // are converted to C-style data structures in `passthrough_event()` so
@@ -494,6 +796,11 @@ class EventHandler {
         const std::optional<EventPayload> value_payload =
             data_converter.read_value(opcode, value);
 
+        std::chrono::steady_clock::time_point profile_serialized{};
+        if (profiler) {
+            profile_serialized = std::chrono::steady_clock::now();
+        }
+
         if (logging) {
             auto [logger, is_dispatch] = *logging;
             logger.log_event(is_dispatch, opcode, index, value, payload, option,
@@ -507,6 +814,29 @@ class EventHandler {
                           .payload = payload,
                           .value_payload = value_payload};
 
+        // Writing the event and reading back the response works the same
+        // regardless of which socket we end up using. Large chunk data is
+        // transferred through a memfd whose descriptor gets passed out of band
+        // directly after the message announcing it, see `ChunkMemfd`.
+        const auto do_roundtrip =
+            [&](boost::asio::local::stream_protocol::socket& roundtrip_socket) {
+                write_object(roundtrip_socket, event);
+                if (const ChunkMemfd* chunk =
+                        std::get_if<ChunkMemfd>(&event.payload)) {
+                    send_fd(roundtrip_socket, chunk->fd);
+                    close(chunk->fd);
+                }
+
+                EventResult response =
+                    read_object<EventResult>(roundtrip_socket);
+                if (ChunkMemfd* chunk =
+                        std::get_if<ChunkMemfd>(&response.payload)) {
+                    chunk->fd = receive_fd(roundtrip_socket);
+                }
+
+                return response;
+            };
+
         // A socket only handles a single request at a time as to prevent
         // messages from arriving out of order. For throughput reasons we prefer
         // to do most communication over a single main socket (`socket`), and
@@ -517,16 +847,18 @@ class EventHandler {
         {
             std::unique_lock lock(write_mutex, std::try_to_lock);
             if (lock.owns_lock()) {
-                write_object(socket, event);
-                response = read_object<EventResult>(socket);
+                response = do_roundtrip(socket);
             } else {
                 try {
                     boost::asio::local::stream_protocol::socket
-                        secondary_socket(io_context);
-                    secondary_socket.connect(endpoint);
+                        secondary_socket = checkout_secondary_socket();
 
-                    write_object(secondary_socket, event);
-                    response = read_object<EventResult>(secondary_socket);
+                    response = do_roundtrip(secondary_socket);
+
+                    // If the round trip failed then the connection is in an
+                    // unknown state, so we'll only reuse sockets whose
+                    // request finished cleanly
+                    return_secondary_socket(std::move(secondary_socket));
                 } catch (const boost::system::system_error&) {
                     // So, what do we do when noone is listening on the endpoint
                     // yet? This can happen with plugin groups when the Wine
@@ -538,12 +870,25 @@ class EventHandler {
                     // let me know.
                     std::lock_guard lock(write_mutex);
 
-                    write_object(socket, event);
-                    response = read_object<EventResult>(socket);
+                    response = do_roundtrip(socket);
                 }
             }
         }
 
+        if (profiler) {
+            // The socket phase is everything that's not accounted for by the
+            // other two phases, so it also includes the bitsery serialization
+            // done inside of `write_object()` and `read_object()` and any
+            // queueing on the other side. The only `send_event()` caller that
+            // doesn't pass a logger is the Wine host's callback sender, so
+            // without logging information we know this was a host callback.
+            const auto profile_end = std::chrono::steady_clock::now();
+            profiler->record_event(
+                logging ? logging->second : false, opcode,
+                profile_end - profile_start, profile_serialized - profile_start,
+                std::chrono::microseconds(response.handling_duration_us));
+        }
+
         if (logging) {
             auto [logger, is_dispatch] = *logging;
             logger.log_event_response(is_dispatch, opcode,
@@ -593,6 +938,13 @@ class EventHandler {
             [&](boost::asio::local::stream_protocol::socket& socket,
                 bool on_main_thread) {
                 auto event = read_object<Event>(socket);
+                // Large chunk data is transferred through a memfd whose
+                // descriptor gets passed right after the message announcing
+                // it, see `ChunkMemfd`
+                if (ChunkMemfd* chunk =
+                        std::get_if<ChunkMemfd>(&event.payload)) {
+                    chunk->fd = receive_fd(socket);
+                }
                 if (logging) {
                     auto [logger, is_dispatch] = *logging;
                     logger.log_event(is_dispatch, event.opcode, event.index,
@@ -600,7 +952,22 @@ class EventHandler {
                                      event.value_payload);
                 }
 
-                EventResult response = callback(event, on_main_thread);
+                // When profiling is enabled we'll time how long the actual
+                // handling took and echo that back to the sending side, so it
+                // can split plugin or host execution time from the socket
+                // overhead, see `EventProfiler`
+                EventResult response;
+                if (EventProfiler::instance()) {
+                    const auto handling_start =
+                        std::chrono::steady_clock::now();
+                    response = callback(event, on_main_thread);
+                    response.handling_duration_us = static_cast<uint32_t>(
+                        std::chrono::duration_cast<std::chrono::microseconds>(
+                            std::chrono::steady_clock::now() - handling_start)
+                            .count());
+                } else {
+                    response = callback(event, on_main_thread);
+                }
                 if (logging) {
                     auto [logger, is_dispatch] = *logging;
                     logger.log_event_response(
@@ -609,51 +976,95 @@ class EventHandler {
                 }
 
                 write_object(socket, response);
+                if (const ChunkMemfd* chunk =
+                        std::get_if<ChunkMemfd>(&response.payload)) {
+                    send_fd(socket, chunk->fd);
+                    close(chunk->fd);
+                }
             };
 
         // As described above we'll handle incoming requests for `socket` on
         // this thread. We'll also listen for incoming connections on `endpoint`
-        // on another thread. For any incoming connection we'll spawn a new
-        // thread to handle the request. When `socket` closes and this loop
-        // breaks, the listener and any still active threads will be cleaned up
-        // before this function exits.
+        // on another thread. Accepted connections get handed to a persistent
+        // pool of worker threads, where every worker serves a single
+        // connection at a time until the sending side closes it again. New
+        // workers are only spawned when a connection comes in while all
+        // existing workers are busy, so steady-state secondary traffic never
+        // creates or destroys any threads. This matters especially on the
+        // Wine side, where thread creation is much more expensive. When
+        // `socket` closes and the loop below breaks, the listener and the
+        // workers will be cleaned up before this function exits.
         boost::asio::io_context secondary_context{};
 
         // The previous acceptor has already been shut down by
         // `EventHandler::connect()`
         acceptor.emplace(secondary_context, endpoint);
 
-        // This works the exact same was as `active_plugins` and
-        // `next_plugin_id` in `GroupBridge`
-        std::map<size_t, Thread> active_secondary_requests{};
-        std::atomic_size_t next_request_id{};
-        std::mutex active_secondary_requests_mutex{};
+        std::deque<boost::asio::local::stream_protocol::socket>
+            pending_connections{};
+        std::mutex workers_mutex{};
+        std::condition_variable workers_cv{};
+        size_t num_idle_workers = 0;
+        bool shutting_down = false;
+
+        const auto worker_loop = [&]() {
+            std::unique_lock lock(workers_mutex);
+            while (true) {
+                workers_cv.wait(lock, [&]() {
+                    return shutting_down || !pending_connections.empty();
+                });
+                if (shutting_down) {
+                    return;
+                }
+
+                boost::asio::local::stream_protocol::socket secondary_socket =
+                    std::move(pending_connections.front());
+                pending_connections.pop_front();
+                num_idle_workers -= 1;
+
+                lock.unlock();
+                try {
+                    while (true) {
+                        process_event(secondary_socket, false);
+                    }
+                } catch (const boost::system::system_error&) {
+                    // Happens when the sending side closes the connection,
+                    // either because its socket pool was already full or
+                    // during shutdown
+                }
+                lock.lock();
+
+                num_idle_workers += 1;
+            }
+        };
+
+        // Declared after everything `worker_loop` references so the implicit
+        // joins at the end of this scope happen before any of that state gets
+        // destroyed
+        std::vector<Thread> workers{};
+
         accept_requests(
             *acceptor, logging,
             [&](boost::asio::local::stream_protocol::socket secondary_socket) {
-                const size_t request_id = next_request_id.fetch_add(1);
-
-                // We have to make sure to keep moving these sockets into the
-                // threads that will handle them
-                std::lock_guard lock(active_secondary_requests_mutex);
-                active_secondary_requests[request_id] = Thread(
-                    [&, request_id](boost::asio::local::stream_protocol::socket
-                                        secondary_socket) {
-                        process_event(secondary_socket, false);
+                std::lock_guard lock(workers_mutex);
+                pending_connections.push_back(std::move(secondary_socket));
+
+                // Spawn additional workers until every queued connection has
+                // an idle worker to pick it up. Comparing against the queue
+                // length instead of just checking for zero idle workers
+                // matters because connections are served until the sending
+                // side closes them again: if two connections got queued onto
+                // a single idle worker, the second one would go unserved and
+                // its sender would block forever. The idle count is bumped
+                // here instead of in the worker itself so a second connection
+                // arriving before the new worker has started doesn't spawn
+                // yet another one.
+                while (num_idle_workers < pending_connections.size()) {
+                    num_idle_workers += 1;
+                    workers.emplace_back(worker_loop);
+                }
 
-                        // When we have processed this request, we'll join the
-                        // thread again with the thread that's handling
-                        // `secondary_context`.
-                        boost::asio::post(secondary_context, [&, request_id]() {
-                            std::lock_guard lock(
-                                active_secondary_requests_mutex);
-
-                            // The join is implicit because we're using
-                            // std::jthread/Win32Thread
-                            active_secondary_requests.erase(request_id);
-                        });
-                    },
-                    std::move(secondary_socket));
+                workers_cv.notify_one();
             });
 
         Thread secondary_requests_handler([&]() { secondary_context.run(); });
@@ -668,10 +1079,18 @@ class EventHandler {
             }
         }
 
-        // After the main socket gets terminated (during shutdown) we'll make
-        // sure all outstanding jobs have been processed and then drop all work
-        // from the IO context
-        std::lock_guard lock(active_secondary_requests_mutex);
+        // After the main socket gets terminated (during shutdown) we'll wake
+        // up all idle workers so they can exit, and then drop all work from
+        // the IO context. Workers that are still serving a connection will
+        // exit once the sending side closes it, and the implicit
+        // std::jthread/Win32Thread joins at the end of this scope wait for
+        // that.
+        {
+            std::lock_guard lock(workers_mutex);
+            shutting_down = true;
+        }
+        workers_cv.notify_all();
+
         secondary_context.stop();
         acceptor.reset();
     }
@@ -721,6 +1140,47 @@ class EventHandler {
             });
     }
 
+    /**
+     * Take a pre-connected secondary socket from the pool, or connect a new
+     * one when the pool is empty. Used in `send_event()` when the main socket
+     * is already being written to by another thread.
+     *
+     * @throw boost::system::system_error If a new connection had to be made
+     *   but nothing is listening on the endpoint yet.
+     */
+    boost::asio::local::stream_protocol::socket checkout_secondary_socket() {
+        {
+            std::lock_guard lock(secondary_socket_pool_mutex);
+            if (!secondary_socket_pool.empty()) {
+                boost::asio::local::stream_protocol::socket secondary_socket =
+                    std::move(secondary_socket_pool.back());
+                secondary_socket_pool.pop_back();
+
+                return secondary_socket;
+            }
+        }
+
+        boost::asio::local::stream_protocol::socket secondary_socket(
+            io_context);
+        secondary_socket.connect(endpoint);
+
+        return secondary_socket;
+    }
+
+    /**
+     * Return a secondary socket to the pool so the next contended
+     * `send_event()` call can reuse the connection. If the pool is already at
+     * `max_pooled_secondary_sockets`, the connection simply gets dropped and
+     * the thread serving it on the other side will exit.
+     */
+    void return_secondary_socket(
+        boost::asio::local::stream_protocol::socket secondary_socket) {
+        std::lock_guard lock(secondary_socket_pool_mutex);
+        if (secondary_socket_pool.size() < max_pooled_secondary_sockets) {
+            secondary_socket_pool.push_back(std::move(secondary_socket));
+        }
+    }
+
     /**
      * The main IO context. New sockets created during `send_event()` will be
      * bound to this context. In `receive_events()` we'll create a new IO
@@ -745,9 +1205,43 @@ class EventHandler {
 
     /**
      * A mutex that locks the main `socket`. If this is locked, then any new
-     * events will be sent over a new socket instead.
+     * events will be sent over a pooled secondary socket instead.
      */
     std::mutex write_mutex;
+
+    /**
+     * Idle pre-connected secondary sockets, ready for reuse by the next
+     * `send_event()` call that finds `write_mutex` locked.
+     *
+     * @relates EventHandler::checkout_secondary_socket
+     * @relates EventHandler::return_secondary_socket
+     */
+    std::vector<boost::asio::local::stream_protocol::socket>
+        secondary_socket_pool;
+    std::mutex secondary_socket_pool_mutex;
+};
+
+/**
+ * The filename of the shared socket endpoint within the base directory used
+ * when `Configuration::single_endpoint` is enabled. The Wine host decides
+ * which mode to use based on whether this file exists, since the
+ * configuration itself only gets sent over after the sockets have connected.
+ */
+constexpr char channels_socket_filename[] = "channels.sock";
+
+/**
+ * Identifies which logical channel a connection made to the shared socket
+ * endpoint belongs to. When `Configuration::single_endpoint` is enabled the
+ * Wine host writes a single byte containing one of these values directly
+ * after connecting, so the plugin side can hand the connection to the right
+ * handler regardless of the order the connections come in.
+ */
+enum class ChannelId : uint8_t {
+    host_vst_dispatch = 0,
+    vst_host_callback = 1,
+    host_vst_parameters = 2,
+    host_vst_process_replacing = 3,
+    host_vst_control = 4,
 };
 
 /**
@@ -761,6 +1255,15 @@ class EventHandler {
  * sockets, and the call to `connect()` will then accept any incoming
  * connections.
  *
+ * There are two endpoint layouts. By default every channel gets its own
+ * socket endpoint within the base directory. With
+ * `Configuration::single_endpoint` enabled there's only a single shared
+ * endpoint, and every connection made to it gets prefixed with a `ChannelId`
+ * byte so it can be routed to the right handler. The channels themselves
+ * remain separate connections either way, since the lockstep
+ * request-response model (and the out of band file descriptor passing for
+ * `ChunkMemfd`) depends on every channel having its own stream.
+ *
  * @tparam Thread The thread implementation to use. On the Linux side this
  *   should be `std::jthread` and on the Wine side this should be `Win32Thread`.
  */
@@ -778,29 +1281,44 @@ class Sockets {
      * @param listen If `true`, start listening on the sockets. Incoming
      *   connections will be accepted when `connect()` gets called. This should
      *   be set to `true` on the plugin side, and `false` on the Wine host side.
+     * @param single_endpoint Whether all channels should share a single
+     *   socket endpoint instead of each getting their own, see the class
+     *   docstring. Only relevant on the listening side; the Wine host detects
+     *   the mode based on which endpoint files exist.
      *
      * @see Sockets::connect
      */
     Sockets(boost::asio::io_context& io_context,
             const boost::filesystem::path& endpoint_base_dir,
-            bool listen)
+            bool listen,
+            bool single_endpoint = false)
         : base_dir(endpoint_base_dir),
+          single_endpoint(
+              listen ? single_endpoint
+                     : boost::filesystem::exists(endpoint_base_dir /
+                                                 channels_socket_filename)),
           host_vst_dispatch(io_context,
                             (base_dir / "host_vst_dispatch.sock").string(),
-                            listen),
+                            listen && !this->single_endpoint),
           vst_host_callback(io_context,
                             (base_dir / "vst_host_callback.sock").string(),
-                            listen),
+                            listen && !this->single_endpoint),
           host_vst_parameters(io_context,
                               (base_dir / "host_vst_parameters.sock").string(),
-                              listen),
+                              listen && !this->single_endpoint),
           host_vst_process_replacing(
               io_context,
               (base_dir / "host_vst_process_replacing.sock").string(),
-              listen),
+              listen && !this->single_endpoint),
           host_vst_control(io_context,
                            (base_dir / "host_vst_control.sock").string(),
-                           listen) {}
+                           listen && !this->single_endpoint),
+          io_context(io_context) {
+        if (listen && this->single_endpoint) {
+            boost::filesystem::create_directories(base_dir);
+            channel_acceptor.emplace(io_context, channel_endpoint());
+        }
+    }
 
     /**
      * Cleans up the directory containing the socket endpoints when yabridge
@@ -832,11 +1350,121 @@ class Sockets {
      * side or connect to the sockets on the Wine side
      */
     void connect() {
-        host_vst_dispatch.connect();
-        vst_host_callback.connect();
-        host_vst_parameters.connect();
-        host_vst_process_replacing.connect();
-        host_vst_control.connect();
+        if (single_endpoint) {
+            if (channel_acceptor) {
+                // The Wine host tags every connection it makes to the shared
+                // endpoint with the channel it belongs to, so the
+                // connections can come in in any order
+                for (size_t i = 0; i < num_channels; i++) {
+                    boost::asio::local::stream_protocol::socket channel_socket(
+                        io_context);
+                    channel_acceptor->accept(channel_socket);
+
+                    uint8_t channel_id;
+                    boost::asio::read(
+                        channel_socket,
+                        boost::asio::buffer(&channel_id, sizeof(channel_id)));
+                    switch (static_cast<ChannelId>(channel_id)) {
+                        case ChannelId::host_vst_dispatch:
+                            host_vst_dispatch.adopt_connection(
+                                std::move(channel_socket));
+                            break;
+                        case ChannelId::vst_host_callback:
+                            vst_host_callback.adopt_connection(
+                                std::move(channel_socket));
+                            break;
+                        case ChannelId::host_vst_parameters:
+                            host_vst_parameters.adopt_connection(
+                                std::move(channel_socket));
+                            break;
+                        case ChannelId::host_vst_process_replacing:
+                            host_vst_process_replacing.adopt_connection(
+                                std::move(channel_socket));
+                            break;
+                        case ChannelId::host_vst_control:
+                            host_vst_control.adopt_connection(
+                                std::move(channel_socket));
+                            break;
+                    }
+                }
+
+                // Just like the per-channel acceptors, this endpoint is no
+                // longer needed once everything is connected. The event
+                // handlers will create their own endpoints for secondary
+                // connections in `EventHandler::receive_events()`.
+                channel_acceptor.reset();
+                boost::filesystem::remove(base_dir /
+                                          channels_socket_filename);
+            } else {
+                const auto connect_channel = [&](ChannelId channel) {
+                    boost::asio::local::stream_protocol::socket channel_socket(
+                        io_context);
+                    channel_socket.connect(channel_endpoint());
+
+                    const uint8_t channel_id = static_cast<uint8_t>(channel);
+                    boost::asio::write(
+                        channel_socket,
+                        boost::asio::buffer(&channel_id, sizeof(channel_id)));
+
+                    return channel_socket;
+                };
+
+                host_vst_dispatch.adopt_connection(
+                    connect_channel(ChannelId::host_vst_dispatch));
+                vst_host_callback.adopt_connection(
+                    connect_channel(ChannelId::vst_host_callback));
+                host_vst_parameters.adopt_connection(
+                    connect_channel(ChannelId::host_vst_parameters));
+                host_vst_process_replacing.adopt_connection(
+                    connect_channel(ChannelId::host_vst_process_replacing));
+                host_vst_control.adopt_connection(
+                    connect_channel(ChannelId::host_vst_control));
+            }
+        } else {
+            // The accepts and connects for the different channels used to
+            // happen strictly in sequence, which put five serial round trips
+            // on the critical path for every plugin instance a project loads.
+            // Since every channel has its own endpoint they can all be
+            // established at the same time, with the implicit thread joins at
+            // the end of the scope below acting as the single wait. This is
+            // startup-only, so the cost of spawning a few threads doesn't
+            // matter here. Exceptions are captured and rethrown on this
+            // thread so error handling stays the same as with the old
+            // sequential version.
+            std::array<std::exception_ptr, 4> connector_errors{};
+            const auto connect_handler = [](auto& handler,
+                                            std::exception_ptr& error) {
+                try {
+                    handler.connect();
+                } catch (...) {
+                    error = std::current_exception();
+                }
+            };
+
+            {
+                Thread dispatch_connector([&]() {
+                    connect_handler(host_vst_dispatch, connector_errors[0]);
+                });
+                Thread callback_connector([&]() {
+                    connect_handler(vst_host_callback, connector_errors[1]);
+                });
+                Thread parameters_connector([&]() {
+                    connect_handler(host_vst_parameters, connector_errors[2]);
+                });
+                Thread process_replacing_connector([&]() {
+                    connect_handler(host_vst_process_replacing,
+                                    connector_errors[3]);
+                });
+
+                host_vst_control.connect();
+            }
+
+            for (const std::exception_ptr& error : connector_errors) {
+                if (error) {
+                    std::rethrow_exception(error);
+                }
+            }
+        }
     }
 
     /**
@@ -845,6 +1473,14 @@ class Sockets {
      */
     const boost::filesystem::path base_dir;
 
+    /**
+     * Whether all channels connect through a single shared socket endpoint
+     * instead of each having their own.
+     *
+     * @see Configuration::single_endpoint
+     */
+    const bool single_endpoint;
+
     // The naming convention for these sockets is `<from>_<to>_<event>`. For
     // instance the socket named `host_vst_dispatch` forwards
     // `AEffect.dispatch()` calls from the native VST host to the Windows VST
@@ -877,6 +1513,32 @@ class Sockets {
      * the configuration (from `config`) back to the Wine host.
      */
     SocketHandler host_vst_control;
+
+   private:
+    /**
+     * The number of logical channels listed above, and thus the number of
+     * connections made through the shared endpoint.
+     */
+    static constexpr size_t num_channels = 5;
+
+    /**
+     * The endpoint all channels connect through when `single_endpoint` is
+     * enabled.
+     */
+    boost::asio::local::stream_protocol::endpoint channel_endpoint() const {
+        return boost::asio::local::stream_protocol::endpoint(
+            (base_dir / channels_socket_filename).string());
+    }
+
+    /**
+     * Accepts the tagged channel connections on the plugin side when
+     * `single_endpoint` is enabled. Like the per-channel acceptors this gets
+     * torn down again at the end of `connect()`.
+     */
+    std::optional<boost::asio::local::stream_protocol::acceptor>
+        channel_acceptor;
+
+    boost::asio::io_context& io_context;
 };
 
 /**
@@ -926,6 +1588,12 @@ EventResult passthrough_event(AEffect* plugin, F callback, Event& event) {
     std::array<char, max_string_length> string_buffer;
     std::fill(string_buffer.begin(), string_buffer.begin() + sizeof(size_t), 0);
 
+    // When the event carries a `ChunkMemfd` (large `effSetChunk` data), we'll
+    // map the chunk into memory for the duration of the call and release the
+    // mapping again after the response has been created
+    void* chunk_mapping = nullptr;
+    uint64_t chunk_mapping_size = 0;
+
     auto read_payload_fn = overload{
         [&](const std::nullptr_t&) -> void* { return nullptr; },
         [&](const std::string& s) -> void* {
@@ -963,7 +1631,13 @@ EventResult passthrough_event(AEffect* plugin, F callback, Event& event) {
         [&](VstParameterProperties& props) -> void* { return &props; },
         [&](WantsVstRect&) -> void* { return string_buffer.data(); },
         [&](const WantsVstTimeInfo&) -> void* { return nullptr; },
-        [&](WantsString&) -> void* { return string_buffer.data(); }};
+        [&](WantsString&) -> void* { return string_buffer.data(); },
+        [&](ChunkMemfd& chunk) -> void* {
+            chunk_mapping = chunk.map();
+            chunk_mapping_size = chunk.size;
+
+            return chunk_mapping;
+        }};
 
     // Almost all events pass data through the `data` argument. There are two
     // events, `effSetParameter` and `effGetParameter` that also pass data
@@ -998,6 +1672,18 @@ EventResult passthrough_event(AEffect* plugin, F callback, Event& event) {
             // return value from the event determines how much data the
             // plugin has written
             const uint8_t* chunk_data = *static_cast<uint8_t**>(data);
+
+            // Large chunks are moved through a memfd whose descriptor gets
+            // passed over the socket, so a 50 MB sampler bank doesn't have to
+            // be serialized byte by byte. If creating the memfd somehow fails
+            // we'll fall back to the regular byte vector.
+            if (static_cast<size_t>(return_value) >= chunk_memfd_min_size) {
+                if (auto chunk =
+                        ChunkMemfd::copy_from(chunk_data, return_value)) {
+                    return *chunk;
+                }
+            }
+
             return std::vector<uint8_t>(chunk_data, chunk_data + return_value);
         },
         [&](VstIOProperties& props) -> EventResultPayload { return props; },
@@ -1054,5 +1740,9 @@ EventResult passthrough_event(AEffect* plugin, F callback, Event& event) {
                          .payload = response_data,
                          .value_payload = value_response_data};
 
+    if (chunk_mapping) {
+        ChunkMemfd::unmap(chunk_mapping, chunk_mapping_size);
+    }
+
     return response;
 }
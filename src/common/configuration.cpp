@@ -78,12 +78,42 @@ Configuration::Configuration(const fs::path& config_path,
         // their defaults. At this point I'd really wish C++ could do pattern
         // matching.
         for (const auto& [key, value] : table) {
-            if (key == "editor_double_embed") {
+            if (key == "cache_parameters") {
+                if (const auto parsed_value = value.as_boolean()) {
+                    cache_parameters = parsed_value->get();
+                } else {
+                    invalid_options.push_back(key);
+                }
+            } else if (key == "editor_double_embed") {
                 if (const auto parsed_value = value.as_boolean()) {
                     editor_double_embed = parsed_value->get();
                 } else {
                     invalid_options.push_back(key);
                 }
+            } else if (key == "low_latency_spin") {
+                if (const auto parsed_value = value.as_boolean()) {
+                    low_latency_spin = parsed_value->get();
+                } else {
+                    invalid_options.push_back(key);
+                }
+            } else if (key == "pipelined_processing") {
+                if (const auto parsed_value = value.as_boolean()) {
+                    pipelined_processing = parsed_value->get();
+                } else {
+                    invalid_options.push_back(key);
+                }
+            } else if (key == "prewarm_hosts") {
+                if (const auto parsed_value = value.as_boolean()) {
+                    prewarm_hosts = parsed_value->get();
+                } else {
+                    invalid_options.push_back(key);
+                }
+            } else if (key == "single_endpoint") {
+                if (const auto parsed_value = value.as_boolean()) {
+                    single_endpoint = parsed_value->get();
+                } else {
+                    invalid_options.push_back(key);
+                }
             } else if (key == "group") {
                 if (const auto parsed_value = value.as_string()) {
                     group = parsed_value->get();
@@ -73,6 +73,17 @@ class Configuration {
     Configuration(const boost::filesystem::path& config_path,
                   const boost::filesystem::path& yabridge_path);
 
+    /**
+     * If this is set to true, then `getParameter()` calls will be answered
+     * from a periodically refreshed cache on the plugin side instead of each
+     * being a full round trip to the Wine VST host. Hosts with generic editors
+     * poll every visible parameter at frame rate, which with very large
+     * numbers of parameters adds up to thousands of round trips per second.
+     * The downside is that parameter changes made by the plugin itself may
+     * show up in the host with a slight delay, hence the flag.
+     */
+    bool cache_parameters = false;
+
     /**
      * If this is set to true, then the plugin editor should be embedded in yet
      * another window. This would result in an embedding sequence of
@@ -87,6 +98,57 @@ class Configuration {
      */
     bool editor_double_embed = false;
 
+    /**
+     * If this is set to true, then both sides of the audio processing round
+     * trip will briefly spin before falling back to a blocking wait. This
+     * skips a scheduler wakeup when the other side responds within tens of
+     * microseconds, which it usually does, at the cost of some additional CPU
+     * usage. This can make a significant difference for live monitoring
+     * chains with small buffer sizes, but since not everyone wants to trade
+     * CPU for latency it's behind a flag.
+     */
+    bool low_latency_spin = false;
+
+    /**
+     * If this is set to true, then audio processing operates one block ahead:
+     * a `processReplacing()` call submits the new block to the Wine VST host
+     * and immediately returns the previous block's results, instead of
+     * blocking for the full round trip. While the Wine process crunches the
+     * submitted block the host's worker thread can already move on to other
+     * plugins, so with hosts that process ahead of the playback deadline
+     * (like REAPER's anticipative FX processing) total bridged throughput
+     * scales with the number of cores instead of with the round trip latency.
+     * The trade-off is one buffer of extra latency that the host's delay
+     * compensation does not know about, hence the flag. Not recommended for
+     * live input monitoring.
+     */
+    bool pipelined_processing = false;
+
+    /**
+     * If this is set to true, then individually hosted plugins will claim
+     * their Wine host process from a pool of pre-warmed processes that's
+     * shared by all plugin instances within the same plugin host process.
+     * Since starting the Wine environment takes one to several seconds and
+     * usually dominates project load times, this makes loading projects with
+     * many yabridge instances considerably faster. The processes in the pool
+     * do consume some memory while they are idling, hence the flag. This
+     * option has no effect when plugin groups are used.
+     */
+    bool prewarm_hosts = false;
+
+    /**
+     * If this is set to true, then all of the instance's communication
+     * channels will connect through a single shared socket endpoint instead
+     * of every channel getting its own endpoint file. This reduces the number
+     * of files per instance and lets the startup handshake happen in any
+     * order. Mainly useful for very large sessions. The Wine host detects
+     * this mode based on which endpoint files exist, so this option doesn't
+     * have to be transferred before the connection is made.
+     *
+     * @see Sockets
+     */
+    bool single_endpoint = false;
+
     /**
      * The name of the plugin group that should be used for the plugin this
      * configuration object was created for. If not set, then the plugin should
@@ -119,7 +181,12 @@ class Configuration {
 
     template <typename S>
     void serialize(S& s) {
+        s.value1b(cache_parameters);
         s.value1b(editor_double_embed);
+        s.value1b(low_latency_spin);
+        s.value1b(pipelined_processing);
+        s.value1b(prewarm_hosts);
+        s.value1b(single_endpoint);
         s.ext(group, bitsery::ext::StdOptional(),
               [](S& s, auto& v) { s.text1b(v, 4096); });
         s.ext(matched_file, bitsery::ext::StdOptional(),
@@ -23,11 +23,14 @@
 #include <vestige/aeffectx.h>
 
 #include <boost/process/environment.hpp>
+#include <algorithm>
 #include <chrono>
+#include <cstring>
 #include <ctime>
 #include <fstream>
 #include <iomanip>
 #include <iostream>
+#include <sstream>
 
 #include "vst24.h"
 
@@ -48,7 +51,13 @@ constexpr char logging_verbosity_environment_variable[] =
 Logger::Logger(std::shared_ptr<std::ostream> stream,
                Verbosity verbosity_level,
                std::string prefix)
-    : stream(stream), verbosity(verbosity_level), prefix(prefix) {}
+    : stream(stream), verbosity(verbosity_level), prefix(prefix) {
+    // With the default verbosity no events get logged, so we also don't need
+    // a queue or a flush thread
+    if (verbosity >= Verbosity::most_events) {
+        event_log_queue = std::make_shared<EventLogQueue>(stream, prefix);
+    }
+}
 
 Logger Logger::create_from_environment(std::string prefix) {
     auto env = boost::this_process::environment();
@@ -105,39 +114,174 @@ void Logger::log(const std::string& message) {
     *stream << formatted_message.str() << std::flush;
 }
 
+/**
+ * The current time, in the format `EventLogRecord`s store their timestamps
+ * in.
+ */
+static std::time_t current_log_timestamp() {
+    return std::chrono::system_clock::to_time_t(
+        std::chrono::system_clock::now());
+}
+
 void Logger::log_get_parameter(int index) {
     if (BOOST_UNLIKELY(verbosity >= Verbosity::most_events)) {
-        std::ostringstream message;
-        message << ">> getParameter() " << index;
-
-        log(message.str());
+        event_log_queue->push(
+            {.type = EventLogRecord::Type::get_parameter,
+             .index = index,
+             .timestamp = current_log_timestamp()});
     }
 }
 
 void Logger::log_get_parameter_response(float value) {
     if (BOOST_UNLIKELY(verbosity >= Verbosity::most_events)) {
-        std::ostringstream message;
-        message << "   getParameter() :: " << value;
-
-        log(message.str());
+        event_log_queue->push(
+            {.type = EventLogRecord::Type::get_parameter_response,
+             .option = value,
+             .timestamp = current_log_timestamp()});
     }
 }
 
 void Logger::log_set_parameter(int index, float value) {
     if (BOOST_UNLIKELY(verbosity >= Verbosity::most_events)) {
-        std::ostringstream message;
-        message << ">> setParameter() " << index << " = " << value;
-
-        log(message.str());
+        event_log_queue->push({.type = EventLogRecord::Type::set_parameter,
+                               .index = index,
+                               .option = value,
+                               .timestamp = current_log_timestamp()});
     }
 }
 
 void Logger::log_set_parameter_response() {
     if (BOOST_UNLIKELY(verbosity >= Verbosity::most_events)) {
-        log("   setParameter() :: OK");
+        event_log_queue->push(
+            {.type = EventLogRecord::Type::set_parameter_response,
+             .timestamp = current_log_timestamp()});
     }
 }
 
+/**
+ * The maximum length of a string that gets copied into a record verbatim.
+ * Matches the old inline logging behavior, where longer strings were assumed
+ * to contain binary data and logged as just their size.
+ */
+constexpr size_t max_inline_string_length = 32;
+
+/**
+ * Copy a string into a summary's fixed size text buffer, truncating and null
+ * terminating it.
+ */
+static void summarize_string(EventLogRecord::PayloadSummary& summary,
+                             const char* string,
+                             size_t length) {
+    const size_t copied = std::min(length, summary.text.size() - 1);
+    std::copy_n(string, copied, summary.text.begin());
+    summary.text[copied] = 0;
+}
+
+/**
+ * Condense an `EventPayload` into the fixed size summary stored in an
+ * `EventLogRecord`.
+ */
+static EventLogRecord::PayloadSummary summarize_payload(
+    const EventPayload& payload) {
+    using Kind = EventLogRecord::PayloadSummary::Kind;
+
+    EventLogRecord::PayloadSummary summary{};
+    std::visit(
+        overload{
+            [&](const std::nullptr_t&) { summary.kind = Kind::null_pointer; },
+            [&](const std::string& s) {
+                summary.kind = Kind::string;
+                summary.size = s.size();
+                summarize_string(summary, s.data(), s.size());
+            },
+            [&](const std::vector<uint8_t>& buffer) {
+                summary.kind = Kind::chunk;
+                summary.size = buffer.size();
+            },
+            [&](const native_size_t& window_id) {
+                summary.kind = Kind::window_handle;
+                summary.size = window_id;
+            },
+            [&](const AEffect&) { summary.kind = Kind::aeffect; },
+            [&](const DynamicVstEvents& events) {
+                summary.kind = Kind::midi_events;
+                summary.size = events.events.size();
+            },
+            [&](const DynamicSpeakerArrangement& speaker_arrangement) {
+                summary.kind = Kind::speaker_arrangement;
+                summary.size = speaker_arrangement.speakers.size();
+            },
+            [&](const VstIOProperties&) { summary.kind = Kind::io_properties; },
+            [&](const VstMidiKeyName&) { summary.kind = Kind::midi_key_name; },
+            [&](const VstParameterProperties&) {
+                summary.kind = Kind::parameter_properties;
+            },
+            [&](const WantsAEffectUpdate&) {
+                summary.kind = Kind::wants_aeffect_update;
+            },
+            [&](const WantsChunkBuffer&) {
+                summary.kind = Kind::wants_chunk_buffer;
+            },
+            [&](const WantsVstRect&) { summary.kind = Kind::wants_vst_rect; },
+            [&](const WantsVstTimeInfo&) {
+                summary.kind = Kind::wants_time_info;
+            },
+            [&](const WantsString&) { summary.kind = Kind::wants_string; },
+            [&](const ChunkMemfd& chunk) {
+                summary.kind = Kind::chunk_memfd;
+                summary.size = chunk.size;
+            }},
+        payload);
+
+    return summary;
+}
+
+/**
+ * The same as the above, but for the responses to events.
+ */
+static EventLogRecord::PayloadSummary summarize_response_payload(
+    const EventResultPayload& payload) {
+    using Kind = EventLogRecord::PayloadSummary::Kind;
+
+    EventLogRecord::PayloadSummary summary{};
+    std::visit(
+        overload{
+            [&](const std::nullptr_t&) { summary.kind = Kind::null_pointer; },
+            [&](const std::string& s) {
+                summary.kind = Kind::string;
+                summary.size = s.size();
+                summarize_string(summary, s.data(), s.size());
+            },
+            [&](const std::vector<uint8_t>& buffer) {
+                summary.kind = Kind::chunk;
+                summary.size = buffer.size();
+            },
+            [&](const AEffect&) { summary.kind = Kind::aeffect; },
+            [&](const DynamicSpeakerArrangement& speaker_arrangement) {
+                summary.kind = Kind::speaker_arrangement;
+                summary.size = speaker_arrangement.speakers.size();
+            },
+            [&](const VstIOProperties&) { summary.kind = Kind::io_properties; },
+            [&](const VstMidiKeyName&) { summary.kind = Kind::midi_key_name; },
+            [&](const VstParameterProperties& props) {
+                summary.kind = Kind::parameter_properties;
+                summarize_string(summary, props.label,
+                                 strnlen(props.label, sizeof(props.label)));
+            },
+            [&](const VstRect& rect) {
+                summary.kind = Kind::vst_rect;
+                summary.rect = {rect.left, rect.top, rect.right, rect.bottom};
+            },
+            [&](const VstTimeInfo&) { summary.kind = Kind::time_info; },
+            [&](const ChunkMemfd& chunk) {
+                summary.kind = Kind::chunk_memfd;
+                summary.size = chunk.size;
+            }},
+        payload);
+
+    return summary;
+}
+
 void Logger::log_event(bool is_dispatch,
                        int opcode,
                        int index,
@@ -150,79 +294,22 @@ void Logger::log_event(bool is_dispatch,
             return;
         }
 
-        std::ostringstream message;
-        if (is_dispatch) {
-            message << ">> dispatch() ";
-        } else {
-            message << ">> audioMasterCallback() ";
-        }
-
-        const auto opcode_name = opcode_to_string(is_dispatch, opcode);
-        if (opcode_name) {
-            message << *opcode_name;
-        } else {
-            message << "<opcode = " << opcode << ">";
-        }
-
-        message << "(index = " << index << ", value = " << value
-                << ", option = " << option << ", data = ";
+        EventLogRecord record{.type = EventLogRecord::Type::event,
+                              .is_dispatch = is_dispatch,
+                              .opcode = opcode,
+                              .index = index,
+                              .value = value,
+                              .option = option,
+                              .timestamp = current_log_timestamp(),
+                              .payload = summarize_payload(payload)};
 
         // Only used during `effSetSpeakerArrangement` and
         // `effGetSpeakerArrangement`
         if (value_payload) {
-            std::visit(
-                overload{
-                    [&](auto) {},
-                    [&](const DynamicSpeakerArrangement& speaker_arrangement) {
-                        message << "<" << speaker_arrangement.speakers.size()
-                                << " input_speakers>, ";
-                    }},
-                *value_payload);
+            record.value_payload = summarize_payload(*value_payload);
         }
 
-        std::visit(
-            overload{
-                [&](const std::nullptr_t&) { message << "<nullptr>"; },
-                [&](const std::string& s) {
-                    if (s.size() < 32) {
-                        message << "\"" << s << "\"";
-                    } else {
-                        // Long strings contain binary data that we probably
-                        // don't want to print
-                        message << "<" << s.size() << " bytes>";
-                    }
-                },
-                [&](const std::vector<uint8_t>& buffer) {
-                    message << "<" << buffer.size() << " byte chunk>";
-                },
-                [&](const native_size_t& window_id) {
-                    message << "<window " << window_id << ">";
-                },
-                [&](const AEffect&) { message << "<nullptr>"; },
-                [&](const DynamicVstEvents& events) {
-                    message << "<" << events.events.size() << " midi_events>";
-                },
-                [&](const DynamicSpeakerArrangement& speaker_arrangement) {
-                    message << "<" << speaker_arrangement.speakers.size()
-                            << " output_speakers>";
-                },
-                [&](const VstIOProperties&) { message << "<io_properties>"; },
-                [&](const VstMidiKeyName&) { message << "<key_name>"; },
-                [&](const VstParameterProperties&) {
-                    message << "<writable_buffer>";
-                },
-                [&](const WantsAEffectUpdate&) { message << "<nullptr>"; },
-                [&](const WantsChunkBuffer&) {
-                    message << "<writable_buffer>";
-                },
-                [&](const WantsVstRect&) { message << "<writable_buffer>"; },
-                [&](const WantsVstTimeInfo&) { message << "<nullptr>"; },
-                [&](const WantsString&) { message << "<writable_string>"; }},
-            payload);
-
-        message << ")";
-
-        log(message.str());
+        event_log_queue->push(record);
     }
 }
 
@@ -237,63 +324,21 @@ void Logger::log_event_response(
             return;
         }
 
-        std::ostringstream message;
-        if (is_dispatch) {
-            message << "   dispatch() :: ";
-        } else {
-            message << "   audioMasterCallback() :: ";
-        }
-
-        message << return_value;
+        EventLogRecord record{
+            .type = EventLogRecord::Type::event_response,
+            .is_dispatch = is_dispatch,
+            .opcode = opcode,
+            .value = return_value,
+            .timestamp = current_log_timestamp(),
+            .payload = summarize_response_payload(payload)};
 
         // Only used during `effSetSpeakerArrangement` and
         // `effGetSpeakerArrangement`
         if (value_payload) {
-            std::visit(
-                overload{
-                    [&](auto) {},
-                    [&](const DynamicSpeakerArrangement& speaker_arrangement) {
-                        message << ", <" << speaker_arrangement.speakers.size()
-                                << " input_speakers>";
-                    }},
-                *value_payload);
+            record.value_payload = summarize_response_payload(*value_payload);
         }
 
-        std::visit(
-            overload{
-                [&](const std::nullptr_t&) {},
-                [&](const std::string& s) {
-                    if (s.size() < 32) {
-                        message << ", \"" << s << "\"";
-                    } else {
-                        // Long strings contain binary data that we probably
-                        // don't want to print
-                        message << ", <" << s.size() << " bytes>";
-                    }
-                },
-                [&](const std::vector<uint8_t>& buffer) {
-                    message << ", <" << buffer.size() << " byte chunk>";
-                },
-                [&](const AEffect&) { message << ", <AEffect_object>"; },
-                [&](const DynamicSpeakerArrangement& speaker_arrangement) {
-                    message << ", <" << speaker_arrangement.speakers.size()
-                            << " output_speakers>";
-                },
-                [&](const VstIOProperties&) { message << ", <io_properties>"; },
-                [&](const VstMidiKeyName&) { message << ", <key_name>"; },
-                [&](const VstParameterProperties& props) {
-                    message << ", <parameter_properties for '" << props.label
-                            << "'>";
-                },
-                [&](const VstRect& rect) {
-                    message << ", {l: " << rect.left << ", t: " << rect.top
-                            << ", r: " << rect.right << ", b: " << rect.bottom
-                            << "}";
-                },
-                [&](const VstTimeInfo&) { message << ", <time_info>"; }},
-            payload);
-
-        log(message.str());
+        event_log_queue->push(record);
     }
 }
 
@@ -315,6 +360,298 @@ bool Logger::should_filter_event(bool is_dispatch, int opcode) const {
     return false;
 }
 
+EventLogQueue::EventLogQueue(std::shared_ptr<std::ostream> stream,
+                             std::string prefix)
+    : stream(stream), prefix(prefix), cells(event_log_queue_size) {
+    for (size_t i = 0; i < cells.size(); i++) {
+        cells[i].sequence.store(i, std::memory_order_relaxed);
+    }
+
+    flush_thread = std::jthread([this](std::stop_token stop_token) {
+        while (!stop_token.stop_requested()) {
+            flush();
+
+            // Simply polling here means the producers never have to do
+            // anything that could block to wake this thread up, and a
+            // millisecond of latency on debug output is irrelevant
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+
+        // Flush one last time so messages logged just before shutdown (or
+        // before an `std::terminate()` somewhere else tears the process down)
+        // still make it to the log
+        flush();
+    });
+}
+
+EventLogQueue::~EventLogQueue() {
+    flush_thread.request_stop();
+    flush_thread.join();
+}
+
+void EventLogQueue::push(const EventLogRecord& record) {
+    size_t position = enqueue_position.load(std::memory_order_relaxed);
+    while (true) {
+        Cell& cell = cells[position % event_log_queue_size];
+        const size_t sequence = cell.sequence.load(std::memory_order_acquire);
+        const intptr_t difference =
+            static_cast<intptr_t>(sequence) - static_cast<intptr_t>(position);
+
+        if (difference == 0) {
+            // The cell is free, try to claim it. Another producer may beat us
+            // to it, in which case `position` gets updated and we try again.
+            if (enqueue_position.compare_exchange_weak(
+                    position, position + 1, std::memory_order_relaxed)) {
+                cell.record = record;
+                cell.sequence.store(position + 1, std::memory_order_release);
+                return;
+            }
+        } else if (difference < 0) {
+            // The ring is full. Blocking here would defeat the entire purpose
+            // of this queue, so the record gets counted and dropped and the
+            // flush thread will report the count once it catches up.
+            dropped_records.fetch_add(1, std::memory_order_relaxed);
+            return;
+        } else {
+            position = enqueue_position.load(std::memory_order_relaxed);
+        }
+    }
+}
+
+bool EventLogQueue::try_pop(EventLogRecord& record) {
+    Cell& cell = cells[dequeue_position % event_log_queue_size];
+    const size_t sequence = cell.sequence.load(std::memory_order_acquire);
+    if (static_cast<intptr_t>(sequence) -
+            static_cast<intptr_t>(dequeue_position + 1) <
+        0) {
+        return false;
+    }
+
+    record = cell.record;
+    cell.sequence.store(dequeue_position + event_log_queue_size,
+                        std::memory_order_release);
+    dequeue_position++;
+
+    return true;
+}
+
+/**
+ * Append the summarized `data` argument of an event to a message, formatted
+ * exactly like the old synchronous visitor over `EventPayload`.
+ */
+static void append_event_payload(
+    std::ostringstream& message,
+    const EventLogRecord::PayloadSummary& payload) {
+    using Kind = EventLogRecord::PayloadSummary::Kind;
+
+    switch (payload.kind) {
+        case Kind::null_pointer:
+        case Kind::aeffect:
+        case Kind::wants_aeffect_update:
+        case Kind::wants_time_info:
+            message << "<nullptr>";
+            break;
+        case Kind::string:
+            if (payload.size < max_inline_string_length) {
+                message << "\"" << payload.text.data() << "\"";
+            } else {
+                // Long strings contain binary data that we probably don't
+                // want to print
+                message << "<" << payload.size << " bytes>";
+            }
+            break;
+        case Kind::chunk:
+            message << "<" << payload.size << " byte chunk>";
+            break;
+        case Kind::window_handle:
+            message << "<window " << payload.size << ">";
+            break;
+        case Kind::midi_events:
+            message << "<" << payload.size << " midi_events>";
+            break;
+        case Kind::speaker_arrangement:
+            message << "<" << payload.size << " output_speakers>";
+            break;
+        case Kind::io_properties:
+            message << "<io_properties>";
+            break;
+        case Kind::midi_key_name:
+            message << "<key_name>";
+            break;
+        case Kind::parameter_properties:
+        case Kind::wants_chunk_buffer:
+        case Kind::wants_vst_rect:
+            message << "<writable_buffer>";
+            break;
+        case Kind::wants_string:
+            message << "<writable_string>";
+            break;
+        case Kind::chunk_memfd:
+            message << "<" << payload.size << " byte chunk over memfd>";
+            break;
+        default:
+            break;
+    }
+}
+
+/**
+ * The same as the above, but for the responses to events.
+ */
+static void append_response_payload(
+    std::ostringstream& message,
+    const EventLogRecord::PayloadSummary& payload) {
+    using Kind = EventLogRecord::PayloadSummary::Kind;
+
+    switch (payload.kind) {
+        case Kind::string:
+            if (payload.size < max_inline_string_length) {
+                message << ", \"" << payload.text.data() << "\"";
+            } else {
+                // Long strings contain binary data that we probably don't
+                // want to print
+                message << ", <" << payload.size << " bytes>";
+            }
+            break;
+        case Kind::chunk:
+            message << ", <" << payload.size << " byte chunk>";
+            break;
+        case Kind::aeffect:
+            message << ", <AEffect_object>";
+            break;
+        case Kind::speaker_arrangement:
+            message << ", <" << payload.size << " output_speakers>";
+            break;
+        case Kind::io_properties:
+            message << ", <io_properties>";
+            break;
+        case Kind::midi_key_name:
+            message << ", <key_name>";
+            break;
+        case Kind::parameter_properties:
+            message << ", <parameter_properties for '" << payload.text.data()
+                    << "'>";
+            break;
+        case Kind::vst_rect:
+            message << ", {l: " << payload.rect[0] << ", t: " << payload.rect[1]
+                    << ", r: " << payload.rect[2] << ", b: " << payload.rect[3]
+                    << "}";
+            break;
+        case Kind::time_info:
+            message << ", <time_info>";
+            break;
+        default:
+            break;
+    }
+}
+
+std::string EventLogQueue::format_record(const EventLogRecord& record) const {
+    using Kind = EventLogRecord::PayloadSummary::Kind;
+
+    std::ostringstream message;
+    switch (record.type) {
+        case EventLogRecord::Type::get_parameter:
+            message << ">> getParameter() " << record.index;
+            break;
+        case EventLogRecord::Type::get_parameter_response:
+            message << "   getParameter() :: " << record.option;
+            break;
+        case EventLogRecord::Type::set_parameter:
+            message << ">> setParameter() " << record.index << " = "
+                    << record.option;
+            break;
+        case EventLogRecord::Type::set_parameter_response:
+            message << "   setParameter() :: OK";
+            break;
+        case EventLogRecord::Type::event: {
+            if (record.is_dispatch) {
+                message << ">> dispatch() ";
+            } else {
+                message << ">> audioMasterCallback() ";
+            }
+
+            const auto opcode_name =
+                opcode_to_string(record.is_dispatch, record.opcode);
+            if (opcode_name) {
+                message << *opcode_name;
+            } else {
+                message << "<opcode = " << record.opcode << ">";
+            }
+
+            message << "(index = " << record.index
+                    << ", value = " << record.value
+                    << ", option = " << record.option << ", data = ";
+
+            // Only used during `effSetSpeakerArrangement` and
+            // `effGetSpeakerArrangement`
+            if (record.value_payload.kind == Kind::speaker_arrangement) {
+                message << "<" << record.value_payload.size
+                        << " input_speakers>, ";
+            }
+
+            append_event_payload(message, record.payload);
+
+            message << ")";
+        } break;
+        case EventLogRecord::Type::event_response: {
+            if (record.is_dispatch) {
+                message << "   dispatch() :: ";
+            } else {
+                message << "   audioMasterCallback() :: ";
+            }
+
+            message << record.value;
+
+            // Only used during `effSetSpeakerArrangement` and
+            // `effGetSpeakerArrangement`
+            if (record.value_payload.kind == Kind::speaker_arrangement) {
+                message << ", <" << record.value_payload.size
+                        << " input_speakers>";
+            }
+
+            append_response_payload(message, record.payload);
+        } break;
+    }
+
+    return message.str();
+}
+
+void EventLogQueue::flush() {
+    EventLogRecord record;
+    while (try_pop(record)) {
+        std::tm tm;
+        localtime_r(&record.timestamp, &tm);
+
+        // Same formatting as in `Logger::log()`, but using the timestamp from
+        // when the record was created rather than from when it got flushed
+        std::ostringstream formatted_message;
+        formatted_message << std::put_time(&tm, "%T") << " ";
+        formatted_message << prefix;
+        formatted_message << format_record(record);
+        formatted_message << std::endl;
+
+        *stream << formatted_message.str() << std::flush;
+    }
+
+    const size_t dropped =
+        dropped_records.exchange(0, std::memory_order_relaxed);
+    if (dropped > 0) {
+        const std::time_t timestamp = std::chrono::system_clock::to_time_t(
+            std::chrono::system_clock::now());
+        std::tm tm;
+        localtime_r(&timestamp, &tm);
+
+        std::ostringstream formatted_message;
+        formatted_message << std::put_time(&tm, "%T") << " ";
+        formatted_message << prefix;
+        formatted_message << "Dropped " << dropped
+                          << " event log messages because the log queue "
+                             "overflowed";
+        formatted_message << std::endl;
+
+        *stream << formatted_message.str() << std::flush;
+    }
+}
+
 std::optional<std::string> opcode_to_string(bool is_dispatch, int opcode) {
     if (is_dispatch) {
         // Opcodes for a plugin's dispatch function
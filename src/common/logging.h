@@ -16,22 +16,224 @@
 
 #pragma once
 
+#include <array>
+#include <atomic>
+#include <ctime>
+#include <memory>
 #include <optional>
 #include <ostream>
+#include <thread>
+#include <vector>
 
 #include "serialization.h"
 
+/**
+ * A compact, fixed size summary of a logged event. Formatting events into
+ * strings and writing them to a file used to happen inline on the thread that
+ * sent the event, which made the timings measured with `YABRIDGE_DEBUG_LEVEL=2`
+ * mostly reflect the cost of the logging itself. Instead the `log_*()`
+ * functions in `Logger` now only fill one of these records and push it onto
+ * `EventLogQueue`, and all of the string formatting and file IO happens on
+ * that queue's background thread.
+ */
+struct EventLogRecord {
+    /**
+     * Which of `Logger`'s event logging functions produced this record. This
+     * determines how the record gets formatted.
+     */
+    enum class Type : uint8_t {
+        get_parameter,
+        get_parameter_response,
+        set_parameter,
+        set_parameter_response,
+        event,
+        event_response,
+    };
+
+    /**
+     * A summary of an `EventPayload` or `EventResultPayload` variant. Since
+     * the records have to be fixed size we can't store the actual payloads,
+     * but the log messages only ever contained sizes, counts and short
+     * strings anyway.
+     */
+    struct PayloadSummary {
+        enum class Kind : uint8_t {
+            /**
+             * There was no payload at all, e.g. for the optional value
+             * payloads that only the speaker arrangement events use.
+             */
+            none,
+            null_pointer,
+            string,
+            chunk,
+            window_handle,
+            aeffect,
+            midi_events,
+            speaker_arrangement,
+            io_properties,
+            midi_key_name,
+            parameter_properties,
+            vst_rect,
+            time_info,
+            wants_aeffect_update,
+            wants_chunk_buffer,
+            wants_vst_rect,
+            wants_time_info,
+            wants_string,
+            chunk_memfd,
+        };
+
+        Kind kind = Kind::none;
+        /**
+         * A generic numeric argument: byte sizes, event and speaker counts,
+         * window IDs and full string lengths.
+         */
+        uint64_t size = 0;
+        /**
+         * The `left`, `top`, `right` and `bottom` fields for `vst_rect`.
+         */
+        std::array<int32_t, 4> rect{{0, 0, 0, 0}};
+        /**
+         * A null terminated inline copy of short strings and parameter
+         * property labels. Longer strings are logged as their size, just like
+         * before, since they usually contain binary data.
+         */
+        std::array<char, 48> text{};
+    };
+
+    Type type;
+    /**
+     * Whether this is a `dispatch()` event or an `audioMaster()` host
+     * callback. Determines the opcode names used while formatting.
+     */
+    bool is_dispatch = false;
+    int32_t opcode = 0;
+    int32_t index = 0;
+    /**
+     * The `value` argument for events, or the return value for event
+     * responses.
+     */
+    int64_t value = 0;
+    /**
+     * The `option` argument for events, and the parameter value for the
+     * `getParameter()`/`setParameter()` record types.
+     */
+    float option = 0.0f;
+    /**
+     * Taken when the record is created so the formatted timestamps don't
+     * shift when the flush thread lags behind.
+     */
+    std::time_t timestamp = 0;
+    PayloadSummary payload{};
+    PayloadSummary value_payload{};
+};
+
+/**
+ * A bounded, lock-free multiple producer single consumer queue of
+ * `EventLogRecord`s, drained by a background thread owned by this object that
+ * formats the records and writes them to the log. This is the bounded MPMC
+ * ring described by Dmitry Vyukov, with a sequence number per cell; we only
+ * ever pop from one thread but the enqueue side has to support every thread
+ * that can send events.
+ *
+ * When the ring is full records are counted and dropped instead of blocking
+ * the producer, and the flush thread reports the number of dropped records
+ * the next time it catches up.
+ *
+ * @note The flush thread is a `std::jthread` even in the Wine host.
+ *   `Win32Thread` is only needed for threads that call into the plugin or
+ *   other third party code, and this thread only touches our own formatting
+ *   and stream code.
+ */
+class EventLogQueue {
+   public:
+    /**
+     * Start the background flush thread.
+     *
+     * @param stream The stream to write the formatted messages to, shared
+     *   with the owning `Logger`.
+     * @param prefix The owning `Logger`'s message prefix.
+     */
+    EventLogQueue(std::shared_ptr<std::ostream> stream, std::string prefix);
+
+    /**
+     * Drains any remaining records before joining the flush thread, so
+     * messages logged right before a crash or shutdown still end up in the
+     * log.
+     */
+    ~EventLogQueue();
+
+    EventLogQueue(const EventLogQueue&) = delete;
+    EventLogQueue& operator=(const EventLogQueue&) = delete;
+
+    /**
+     * Try to push a record onto the ring. When the ring is full the record is
+     * dropped and counted instead, so this never blocks.
+     */
+    void push(const EventLogRecord& record);
+
+   private:
+    /**
+     * The number of records the ring can hold. At 128 bytes and change per
+     * record this is still well under a megabyte, while being an order of
+     * magnitude more than the number of events even the chattiest plugin
+     * sends between two runs of the flush thread.
+     */
+    static constexpr size_t event_log_queue_size = 4096;
+
+    struct Cell {
+        std::atomic_size_t sequence = 0;
+        EventLogRecord record;
+    };
+
+    /**
+     * Pop the oldest record from the ring. May only be called from the flush
+     * thread.
+     */
+    bool try_pop(EventLogRecord& record);
+
+    /**
+     * Format a record exactly like the old synchronous logging code did.
+     */
+    std::string format_record(const EventLogRecord& record) const;
+
+    /**
+     * Drain the ring, format and write all pending records, and report any
+     * records that were dropped since the last run.
+     */
+    void flush();
+
+    std::shared_ptr<std::ostream> stream;
+    std::string prefix;
+
+    std::vector<Cell> cells;
+    alignas(64) std::atomic_size_t enqueue_position = 0;
+    alignas(64) size_t dequeue_position = 0;
+    /**
+     * The number of records that were dropped because the ring was full.
+     */
+    alignas(64) std::atomic_size_t dropped_records = 0;
+
+    std::jthread flush_thread;
+};
+
 /**
  * Super basic logging facility meant for debugging malfunctioning VST
  * plugins. This is also used to redirect the output of the Wine process
  * because DAWs like Bitwig hide this from you, making it hard to debug
  * crashing plugins.
  *
- * @note This does not do any synchronisation. While this should technically
- *   be causing problems in concurrent use, writing strings to fstreams from
- *   multiple threads at the same time doesn't seem to produce corrupted text if
- *   you're writing an entire string at once even though the messages may be
- *   slightly out of order.
+ * The event logging functions don't do any formatting or IO themselves. They
+ * push compact records onto `EventLogQueue`, whose background thread takes
+ * care of the rest, so event logging can be left enabled while profiling or
+ * during production sessions without perturbing the timings.
+ *
+ * @note The plain `log()` function does not do any synchronisation with the
+ *   flush thread. While this should technically be causing problems in
+ *   concurrent use, writing strings to fstreams from multiple threads at the
+ *   same time doesn't seem to produce corrupted text if you're writing an
+ *   entire string at once even though the messages may be slightly out of
+ *   order.
  */
 class Logger {
    public:
@@ -135,6 +337,14 @@ class Logger {
      * A prefix that gets prepended before every message.
      */
     std::string prefix;
+
+    /**
+     * The queue the event logging functions push their records onto. Only
+     * created when the verbosity level includes events, so with the default
+     * verbosity there's no queue and no flush thread at all. Shared so
+     * copies of this logger keep logging to the same queue.
+     */
+    std::shared_ptr<EventLogQueue> event_log_queue;
 };
 
 /**
@@ -0,0 +1,161 @@
+// yabridge: a Wine VST bridge
+// Copyright (C) 2020  Robbert van der Helm
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include <atomic>
+#include <vector>
+
+#include "serialization.h"
+
+/**
+ * A bounded, lock-free single producer single consumer queue for passing MIDI
+ * event batches between a socket handling thread and the audio thread. Both
+ * sides of the bridge used to guard a `std::vector<DynamicVstEvents>` with a
+ * mutex for this, which meant that dense MIDI streams (think MPE controllers
+ * ramping 14-bit CCs) could block the audio thread behind the thread that was
+ * still enqueueing events.
+ *
+ * The queue is a fixed size ring of `DynamicVstEvents` slots that doubles as
+ * an arena: batches are copied into a slot's existing buffers on push, and
+ * popping a batch merely advances the read index without touching the slot.
+ * Since the slots and their heap buffers are reused on every lap around the
+ * ring, pushes stop allocating once the slots have grown to the size of the
+ * host's usual batches, and the consumer never locks or allocates at all.
+ * The consumer releasing the batches it has processed at the end of every
+ * audio cycle takes the place of clearing the old vector.
+ *
+ * Because released slots are not rewritten until the producer has gone all
+ * the way around the ring, the `VstEvent` objects inside a popped batch also
+ * stay valid for at least another `midi_queue_capacity` batches. Some plugins
+ * (Kontakt) rely on events living until the next audio buffer has been
+ * processed, which this comfortably covers.
+ */
+class MidiEventQueue {
+   public:
+    /**
+     * The number of event batches the ring can hold. Hosts only send a couple
+     * of `effProcessEvents`/`audioMasterProcessEvents` batches per processing
+     * cycle and the consumer drains the queue every cycle, so this should
+     * never fill up during normal playback.
+     */
+    static constexpr size_t midi_queue_capacity = 256;
+
+    MidiEventQueue() : slots(midi_queue_capacity) {}
+
+    MidiEventQueue(const MidiEventQueue&) = delete;
+    MidiEventQueue& operator=(const MidiEventQueue&) = delete;
+
+    /**
+     * Copy an event batch into the next free slot and publish it to the
+     * consumer. The batch's `VstEvents` struct is built here, on the producer
+     * thread, so that the consumer can call `as_c_events()` on the returned
+     * object without allocating. May only be called from the producer thread.
+     *
+     * When the ring is full (i.e. the host is sending events without
+     * processing any audio) the batch is instead written to a fallback slot
+     * that's not visible to the consumer, so the caller can always hand the
+     * returned events to a plugin right away. In that situation the host
+     * would have discarded the events anyway, as MIDI output outside of an
+     * audio callback is not allowed.
+     *
+     * @param events The batch of events to enqueue.
+     *
+     * @return A reference to the enqueued copy. Valid until the producer has
+     *   pushed another `midi_queue_capacity` batches.
+     */
+    DynamicVstEvents& push(const DynamicVstEvents& events) {
+        const size_t current_write =
+            write_index.load(std::memory_order_relaxed);
+        const bool queue_full =
+            current_write - read_index.load(std::memory_order_acquire) ==
+            midi_queue_capacity;
+
+        // Copy assignment reuses the slot's existing vector capacities, so
+        // after the first few laps around the ring this doesn't allocate
+        DynamicVstEvents& slot = queue_full
+                                     ? overflow_slot
+                                     : slots[current_write %
+                                             midi_queue_capacity];
+        slot = events;
+        slot.as_c_events();
+
+        if (!queue_full) {
+            write_index.store(current_write + 1, std::memory_order_release);
+        }
+
+        return slot;
+    }
+
+    /**
+     * Return a pointer to the oldest batch that has not yet been popped, or a
+     * null pointer when the queue is empty. May only be called from the
+     * consumer thread.
+     */
+    DynamicVstEvents* peek() {
+        const size_t current_read = read_index.load(std::memory_order_relaxed);
+        if (current_read == write_index.load(std::memory_order_acquire)) {
+            return nullptr;
+        }
+
+        return &slots[current_read % midi_queue_capacity];
+    }
+
+    /**
+     * Release the batch last returned by `peek()` so its slot can eventually
+     * be reused by the producer. May only be called from the consumer thread.
+     */
+    void pop() {
+        read_index.store(read_index.load(std::memory_order_relaxed) + 1,
+                         std::memory_order_release);
+    }
+
+    /**
+     * Release every batch that has been published so far. Used on the Wine
+     * side after a processing cycle, where the batches have already been
+     * handed to the plugin on the producer thread and are only kept around so
+     * the events stay alive until the next audio buffer. May only be called
+     * from the consumer thread.
+     */
+    void release_all() {
+        read_index.store(write_index.load(std::memory_order_acquire),
+                         std::memory_order_release);
+    }
+
+   private:
+    /**
+     * The ring of event batches. The slots are default constructed once and
+     * then only ever assigned to, so their heap buffers act as a per-instance
+     * arena.
+     */
+    std::vector<DynamicVstEvents> slots;
+
+    /**
+     * The slot `push()` falls back to when the ring is full. Only ever
+     * touched by the producer thread.
+     */
+    DynamicVstEvents overflow_slot;
+
+    /**
+     * Monotonically increasing batch counters. These are only ever reduced
+     * modulo `midi_queue_capacity` when indexing into `slots`, which sidesteps
+     * the usual empty-versus-full ambiguity of ring buffer indices. Aligned to
+     * (presumed) cache line boundaries to prevent the two threads from false
+     * sharing.
+     */
+    alignas(64) std::atomic_size_t write_index = 0;
+    alignas(64) std::atomic_size_t read_index = 0;
+};
@@ -0,0 +1,266 @@
+// yabridge: a Wine VST bridge
+// Copyright (C) 2020  Robbert van der Helm
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include <vestige/aeffectx.h>
+
+#include <array>
+#include <cstdint>
+
+#include "vst24.h"
+
+// This file classifies the VST2 opcodes from `vestige/aeffectx.h` and
+// `vst24.h` in compile time lookup tables. This knowledge used to be
+// duplicated between the switch statements in `DispatchDataConverter`,
+// `HostCallbackDataConverter` and the Wine host's list of opcodes that have
+// to be handled on the main thread, and classifying an opcode meant walking
+// one of those chains (or a `std::set`) on every single event.
+
+/**
+ * The kind of payload that's passed along with an opcode through the `data`
+ * argument, or written back to it from the response. Most of these correspond
+ * directly to one of the variants of `EventPayload`, the `wants_*` kinds are
+ * the empty marker structs that ask the other side to provide the value.
+ *
+ * @see DefaultDataConverter
+ */
+enum class Vst2PayloadKind : uint8_t {
+    /**
+     * No opcode specific handling. `DefaultDataConverter`'s null pointer or
+     * C-style string behavior applies.
+     */
+    fallback,
+    /**
+     * An `AEffect` struct, as sent along with `audioMasterIOChanged` and
+     * returned in response to `effOpen`.
+     */
+    aeffect,
+    /**
+     * A request for the other side to send an updated `AEffect` struct, for
+     * `effOpen`.
+     */
+    wants_aeffect_update,
+    /**
+     * A `VstRect` with the editor dimensions, returned for `effEditGetRect`.
+     */
+    vst_rect,
+    /**
+     * A request for the above, sent along with `effEditGetRect`.
+     */
+    wants_vst_rect,
+    /**
+     * A native window handle (an X11 window ID), passed as a pointer sized
+     * integer during `effEditOpen`.
+     */
+    native_window_handle,
+    /**
+     * Opaque chunk data, as passed during `effSetChunk` and returned for
+     * `effGetChunk`.
+     */
+    chunk,
+    /**
+     * A request for the plugin's chunk data, sent along with `effGetChunk`.
+     */
+    wants_chunk_buffer,
+    /**
+     * A batch of MIDI events, for `effProcessEvents` and
+     * `audioMasterProcessEvents`.
+     */
+    midi_events,
+    /**
+     * A `VstIOProperties` struct, for `effGetInputProperties` and
+     * `effGetOutputProperties`.
+     */
+    io_properties,
+    /**
+     * A `VstParameterProperties` struct, for `effGetParameterProperties`.
+     */
+    parameter_properties,
+    /**
+     * A `VstMidiKeyName` struct, for `effGetMidiKeyName`.
+     */
+    midi_key_name,
+    /**
+     * A `VstSpeakerArrangement` struct, for `effSetSpeakerArrangement` and
+     * `effGetSpeakerArrangement`.
+     */
+    speaker_arrangement,
+    /**
+     * A null terminated string buffer the other side should fill, for the
+     * various `eff(Get*{Name,Label,Display}` and
+     * `audioMasterGet{Vendor,Product}String` opcodes. The default converter
+     * behavior can usually detect these by looking for a zeroed out buffer,
+     * but not all hosts and plugins zero out their buffers.
+     */
+    wants_string,
+    /**
+     * A `VstTimeInfo` struct with the host's transport information, returned
+     * for `audioMasterGetTime`.
+     */
+    time_info,
+    /**
+     * A request for the above, sent along with `audioMasterGetTime`.
+     */
+    wants_time_info,
+};
+
+/**
+ * Everything we know about a single opcode. A default constructed instance
+ * describes an opcode without any special handling.
+ */
+struct Vst2OpcodeTraits {
+    /**
+     * The kind of payload that accompanies the event, read from the `data`
+     * argument.
+     */
+    Vst2PayloadKind payload = Vst2PayloadKind::fallback;
+    /**
+     * The kind of payload the response contains, to be written back to the
+     * `data` argument.
+     */
+    Vst2PayloadKind response = Vst2PayloadKind::fallback;
+    /**
+     * Whether the event also carries a payload behind the `value` argument.
+     * Only the speaker arrangement opcodes do this, they pass the input
+     * configuration through `value` and the output configuration through
+     * `data`.
+     */
+    bool value_payload = false;
+    /**
+     * Whether the Wine host has to pass the event to the plugin from the main
+     * thread because it may involve GUI operations or the Win32 message loop.
+     */
+    bool needs_main_thread = false;
+};
+
+/**
+ * The size of the opcode lookup tables below. The highest opcode we know of
+ * is `effBeginLoadProgram` (76), with some headroom since hosts and plugins
+ * are free to send opcodes we don't know about.
+ */
+constexpr size_t vst2_opcode_table_size = 128;
+
+using Vst2OpcodeTraitsTable =
+    std::array<Vst2OpcodeTraits, vst2_opcode_table_size>;
+
+/**
+ * Build the traits table for the plugin -> host `dispatch()` opcodes.
+ */
+constexpr Vst2OpcodeTraitsTable build_dispatch_opcode_traits() {
+    Vst2OpcodeTraitsTable table{};
+
+    table[effOpen] = {.payload = Vst2PayloadKind::wants_aeffect_update,
+                      .response = Vst2PayloadKind::aeffect,
+                      .needs_main_thread = true};
+    table[effClose] = {.needs_main_thread = true};
+    table[effEditGetRect] = {.payload = Vst2PayloadKind::wants_vst_rect,
+                             .response = Vst2PayloadKind::vst_rect,
+                             .needs_main_thread = true};
+    table[effEditOpen] = {.payload = Vst2PayloadKind::native_window_handle,
+                          .needs_main_thread = true};
+    table[effEditClose] = {.needs_main_thread = true};
+    table[effEditIdle] = {.needs_main_thread = true};
+    table[effEditTop] = {.needs_main_thread = true};
+    table[effGetChunk] = {.payload = Vst2PayloadKind::wants_chunk_buffer,
+                          .response = Vst2PayloadKind::chunk};
+    table[effSetChunk] = {.payload = Vst2PayloadKind::chunk};
+    table[effProcessEvents] = {.payload = Vst2PayloadKind::midi_events};
+    table[effGetInputProperties] = {
+        .payload = Vst2PayloadKind::io_properties,
+        .response = Vst2PayloadKind::io_properties};
+    table[effGetOutputProperties] = {
+        .payload = Vst2PayloadKind::io_properties,
+        .response = Vst2PayloadKind::io_properties};
+    table[effGetParameterProperties] = {
+        .payload = Vst2PayloadKind::parameter_properties,
+        .response = Vst2PayloadKind::parameter_properties};
+    table[effGetMidiKeyName] = {.payload = Vst2PayloadKind::midi_key_name,
+                                .response = Vst2PayloadKind::midi_key_name};
+    table[effSetSpeakerArrangement] = {
+        .payload = Vst2PayloadKind::speaker_arrangement,
+        .value_payload = true};
+    table[effGetSpeakerArrangement] = {
+        .payload = Vst2PayloadKind::speaker_arrangement,
+        .response = Vst2PayloadKind::speaker_arrangement,
+        .value_payload = true};
+
+    // Any VST host I've encountered has properly zeroed out their string
+    // buffers so the fallback behavior would also detect these, but we'll
+    // classify every string returning opcode just in case
+    table[effGetProgramName] = {.payload = Vst2PayloadKind::wants_string};
+    table[effGetParamLabel] = {.payload = Vst2PayloadKind::wants_string};
+    table[effGetParamDisplay] = {.payload = Vst2PayloadKind::wants_string};
+    table[effGetParamName] = {.payload = Vst2PayloadKind::wants_string};
+    table[effGetProgramNameIndexed] = {.payload =
+                                           Vst2PayloadKind::wants_string};
+    table[effGetEffectName] = {.payload = Vst2PayloadKind::wants_string};
+    table[effGetVendorString] = {.payload = Vst2PayloadKind::wants_string};
+    table[effGetProductString] = {.payload = Vst2PayloadKind::wants_string};
+    table[effShellGetNextPlugin] = {.payload = Vst2PayloadKind::wants_string};
+
+    return table;
+}
+
+/**
+ * Build the traits table for the plugin -> host `audioMaster()` callback
+ * opcodes. The `needs_main_thread` flag is never set here since host
+ * callbacks are always handled by whatever thread receives them.
+ */
+constexpr Vst2OpcodeTraitsTable build_host_callback_opcode_traits() {
+    Vst2OpcodeTraitsTable table{};
+
+    table[audioMasterGetTime] = {.payload = Vst2PayloadKind::wants_time_info,
+                                 .response = Vst2PayloadKind::time_info};
+    table[audioMasterIOChanged] = {.payload = Vst2PayloadKind::aeffect};
+    table[audioMasterProcessEvents] = {.payload =
+                                           Vst2PayloadKind::midi_events};
+    table[audioMasterGetVendorString] = {.payload =
+                                             Vst2PayloadKind::wants_string};
+    table[audioMasterGetProductString] = {.payload =
+                                              Vst2PayloadKind::wants_string};
+
+    return table;
+}
+
+inline constexpr Vst2OpcodeTraitsTable dispatch_opcode_traits_table =
+    build_dispatch_opcode_traits();
+inline constexpr Vst2OpcodeTraitsTable host_callback_opcode_traits_table =
+    build_host_callback_opcode_traits();
+
+/**
+ * Fetch the traits for a `dispatch()` opcode. Unknown opcodes get the default
+ * traits, i.e. the fallback data converter behavior.
+ */
+constexpr Vst2OpcodeTraits dispatch_opcode_traits(const int opcode) {
+    if (static_cast<size_t>(opcode) >= vst2_opcode_table_size) {
+        return Vst2OpcodeTraits{};
+    }
+
+    return dispatch_opcode_traits_table[opcode];
+}
+
+/**
+ * Fetch the traits for an `audioMaster()` host callback opcode. Unknown
+ * opcodes get the default traits, i.e. the fallback data converter behavior.
+ */
+constexpr Vst2OpcodeTraits host_callback_opcode_traits(const int opcode) {
+    if (static_cast<size_t>(opcode) >= vst2_opcode_table_size) {
+        return Vst2OpcodeTraits{};
+    }
+
+    return host_callback_opcode_traits_table[opcode];
+}
@@ -0,0 +1,220 @@
+// yabridge: a Wine VST bridge
+// Copyright (C) 2020  Robbert van der Helm
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#include "profiling.h"
+
+#ifdef __WINE__
+#include "../wine-host/boost-fix.h"
+#endif
+
+#include <boost/process/environment.hpp>
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <csignal>
+#include <sstream>
+
+/**
+ * The environment variable that enables the latency profiling described in
+ * `EventProfiler`. Profiling is enabled when this is set to any non-empty
+ * value. Since the plugin passes its entire environment on to the Wine host,
+ * setting this in the host's environment enables profiling on both sides of
+ * the bridge at once.
+ */
+constexpr char profiling_environment_variable[] = "YABRIDGE_PROFILE";
+
+/**
+ * Set from the signal handler when a `SIGUSR2` comes in, and serviced by
+ * `EventProfiler::handle_pending_dump()`.
+ */
+static std::atomic_bool dump_requested = false;
+
+static void handle_dump_signal(int /*signal*/) {
+    dump_requested.store(true, std::memory_order_relaxed);
+}
+
+void LatencyHistogram::record(std::chrono::nanoseconds duration) {
+    const uint64_t duration_us =
+        std::chrono::duration_cast<std::chrono::microseconds>(
+            std::max(duration, std::chrono::nanoseconds(0)))
+            .count();
+
+    // `bit_width()` maps zero to bucket zero and `[2^(i - 1), 2^i)` to bucket
+    // `i`, which is exactly the log2 bucketing we're after
+    const size_t bucket =
+        std::min(static_cast<size_t>(std::bit_width(duration_us)),
+                 num_buckets - 1);
+    buckets[bucket].fetch_add(1, std::memory_order_relaxed);
+
+    uint64_t current_max = max_us.load(std::memory_order_relaxed);
+    while (duration_us > current_max &&
+           !max_us.compare_exchange_weak(current_max, duration_us,
+                                         std::memory_order_relaxed)) {
+    }
+}
+
+uint64_t LatencyHistogram::count() const {
+    uint64_t total = 0;
+    for (const auto& bucket : buckets) {
+        total += bucket.load(std::memory_order_relaxed);
+    }
+
+    return total;
+}
+
+uint64_t LatencyHistogram::percentile(double percentile) const {
+    std::array<uint64_t, num_buckets> counts{};
+    uint64_t total = 0;
+    for (size_t bucket = 0; bucket < num_buckets; bucket++) {
+        counts[bucket] = buckets[bucket].load(std::memory_order_relaxed);
+        total += counts[bucket];
+    }
+    if (total == 0) {
+        return 0;
+    }
+
+    const auto target =
+        static_cast<uint64_t>(std::ceil(percentile * static_cast<double>(total)));
+    uint64_t seen = 0;
+    for (size_t bucket = 0; bucket < num_buckets; bucket++) {
+        seen += counts[bucket];
+        if (seen >= target) {
+            // Report the upper bound of the bucket the percentile falls in,
+            // clamped to the actual maximum so `p99 <= max` always holds
+            const uint64_t upper_bound =
+                bucket == 0 ? 1 : static_cast<uint64_t>(1) << bucket;
+            return std::min(upper_bound, std::max<uint64_t>(max(), 1));
+        }
+    }
+
+    return max();
+}
+
+uint64_t LatencyHistogram::max() const {
+    return max_us.load(std::memory_order_relaxed);
+}
+
+EventProfiler* EventProfiler::instance() {
+    static EventProfiler* profiler = []() -> EventProfiler* {
+        auto env = boost::this_process::environment();
+        if (env[profiling_environment_variable].to_string().empty()) {
+            return nullptr;
+        }
+
+        // Deliberately leaked. Events can still be sent while static objects
+        // are being destroyed during shutdown, so the profiler has to outlive
+        // everything else.
+        return new EventProfiler();
+    }();
+
+    return profiler;
+}
+
+EventProfiler::EventProfiler() {
+    struct sigaction dump_action {};
+    dump_action.sa_handler = handle_dump_signal;
+    sigemptyset(&dump_action.sa_mask);
+    sigaction(SIGUSR2, &dump_action, nullptr);
+}
+
+void EventProfiler::record_event(bool is_dispatch,
+                                 int opcode,
+                                 std::chrono::nanoseconds total,
+                                 std::chrono::nanoseconds serialize,
+                                 std::chrono::nanoseconds remote) {
+    const size_t index =
+        std::min(static_cast<size_t>(std::max(opcode, 0)),
+                 vst2_opcode_table_size - 1);
+    OpcodeLatencies& latencies =
+        is_dispatch ? dispatch_latencies[index] : callback_latencies[index];
+
+    latencies.total.record(total);
+    latencies.serialize.record(serialize);
+    latencies.remote.record(remote);
+    latencies.socket.record(
+        std::max(total - serialize - remote, std::chrono::nanoseconds(0)));
+
+    handle_pending_dump();
+}
+
+void EventProfiler::record_audio_processing(std::chrono::nanoseconds duration) {
+    audio_processing_latencies.total.record(duration);
+    handle_pending_dump();
+}
+
+void EventProfiler::record_parameters(std::chrono::nanoseconds duration) {
+    parameter_latencies.total.record(duration);
+    handle_pending_dump();
+}
+
+void EventProfiler::dump(Logger& logger) const {
+    logger.log("");
+    logger.log("Event profiling results, all times in microseconds as p50/p99/max:");
+    for (size_t opcode = 0; opcode < vst2_opcode_table_size; opcode++) {
+        dump_latencies(
+            logger,
+            "dispatch() " + opcode_to_string(true, static_cast<int>(opcode))
+                                .value_or(std::to_string(opcode)),
+            dispatch_latencies[opcode], true);
+    }
+    for (size_t opcode = 0; opcode < vst2_opcode_table_size; opcode++) {
+        dump_latencies(
+            logger,
+            "audioMaster() " + opcode_to_string(false, static_cast<int>(opcode))
+                                   .value_or(std::to_string(opcode)),
+            callback_latencies[opcode], true);
+    }
+    dump_latencies(logger, "audio processing cycle", audio_processing_latencies,
+                   false);
+    dump_latencies(logger, "parameter round trip", parameter_latencies, false);
+    logger.log("");
+}
+
+void EventProfiler::handle_pending_dump() {
+    if (dump_requested.exchange(false, std::memory_order_relaxed)) {
+        Logger logger = Logger::create_from_environment();
+        dump(logger);
+    }
+}
+
+std::string EventProfiler::format_histogram(const LatencyHistogram& histogram) {
+    std::ostringstream formatted;
+    formatted << histogram.percentile(0.50) << "/" << histogram.percentile(0.99)
+              << "/" << histogram.max();
+
+    return formatted.str();
+}
+
+void EventProfiler::dump_latencies(Logger& logger,
+                                   const std::string& name,
+                                   const OpcodeLatencies& latencies,
+                                   bool with_phases) const {
+    const uint64_t count = latencies.total.count();
+    if (count == 0) {
+        return;
+    }
+
+    std::ostringstream message;
+    message << "  " << name << ": n = " << count << ", total "
+            << format_histogram(latencies.total);
+    if (with_phases) {
+        message << ", serialize " << format_histogram(latencies.serialize)
+                << ", socket " << format_histogram(latencies.socket)
+                << ", remote " << format_histogram(latencies.remote);
+    }
+
+    logger.log(message.str());
+}
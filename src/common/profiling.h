@@ -0,0 +1,180 @@
+// yabridge: a Wine VST bridge
+// Copyright (C) 2020  Robbert van der Helm
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+
+#include "logging.h"
+#include "opcode-traits.h"
+
+/**
+ * A histogram of latencies with logarithmic microsecond buckets, so it covers
+ * everything from sub-microsecond to over half an hour with constant memory.
+ * Recording is a single relaxed atomic increment plus an atomic max update,
+ * so it's cheap enough for the audio path, and all the bucket walking happens
+ * when the results get dumped.
+ */
+class LatencyHistogram {
+   public:
+    /**
+     * Record a single measurement.
+     */
+    void record(std::chrono::nanoseconds duration);
+
+    /**
+     * The total number of recorded measurements.
+     */
+    uint64_t count() const;
+
+    /**
+     * Estimate the given percentile (from 0.0 to 1.0), in microseconds. Since
+     * the buckets are logarithmic this returns the upper bound of the bucket
+     * the percentile falls in. Returns zero when nothing has been recorded.
+     */
+    uint64_t percentile(double percentile) const;
+
+    /**
+     * The largest recorded measurement, in microseconds.
+     */
+    uint64_t max() const;
+
+   private:
+    /**
+     * Bucket `i` counts measurements of `[2^(i - 1), 2^i)` microseconds, with
+     * bucket zero counting everything under a microsecond and the last bucket
+     * acting as a catch-all for anything over `2^30` microseconds.
+     */
+    static constexpr size_t num_buckets = 32;
+
+    std::array<std::atomic_uint64_t, num_buckets> buckets{};
+    std::atomic_uint64_t max_us = 0;
+};
+
+/**
+ * Opt-in instrumentation for answering where bridge time goes without an
+ * external profiler, since those can't cross the Wine boundary. When the
+ * `YABRIDGE_PROFILE` environment variable is set, `EventHandler::send_event()`
+ * timestamps every event round trip and feeds per-opcode latency histograms,
+ * split into a serialize phase (capturing the payload), a remote execution
+ * phase (the handling time echoed back by the other side in
+ * `EventResult::handling_duration_us`) and a socket phase (everything that's
+ * left: serialization proper, the transfer, and queueing on both ends). Audio
+ * processing cycles and parameter round trips get their own histograms.
+ *
+ * The results are dumped through the regular `Logger` when a bridge instance
+ * shuts down, or on demand by sending the process `SIGUSR2`. Since this is
+ * process wide, the histograms aggregate over every plugin instance hosted by
+ * the process.
+ */
+class EventProfiler {
+   public:
+    /**
+     * The process wide profiler instance, or a null pointer when
+     * `YABRIDGE_PROFILE` is not set. Hot paths should skip all of their
+     * timestamping when this returns a null pointer.
+     */
+    static EventProfiler* instance();
+
+    /**
+     * Record a single event round trip made through
+     * `EventHandler::send_event()`.
+     *
+     * @param is_dispatch Whether this was a `dispatch()` event or an
+     *   `audioMaster()` host callback. Determines the opcode names used in
+     *   the dump.
+     * @param opcode The event's opcode.
+     * @param total The full round trip time.
+     * @param serialize The time spent capturing the payload before sending.
+     * @param remote The handling time echoed back by the other side, or zero
+     *   when the other side does not have profiling enabled.
+     */
+    void record_event(bool is_dispatch,
+                      int opcode,
+                      std::chrono::nanoseconds total,
+                      std::chrono::nanoseconds serialize,
+                      std::chrono::nanoseconds remote);
+
+    /**
+     * Record a full audio processing cycle in
+     * `PluginBridge::do_process()`.
+     */
+    void record_audio_processing(std::chrono::nanoseconds duration);
+
+    /**
+     * Record a `ParameterBatch` round trip over the `host_vst_parameters`
+     * socket.
+     */
+    void record_parameters(std::chrono::nanoseconds duration);
+
+    /**
+     * Write all non-empty histograms to the log.
+     */
+    void dump(Logger& logger) const;
+
+    /**
+     * When a `SIGUSR2` has come in since the last call, dump the results to a
+     * logger created from the environment. Called from the `record_*()`
+     * functions so the dump happens on a normal thread instead of inside the
+     * signal handler.
+     */
+    void handle_pending_dump();
+
+   private:
+    EventProfiler();
+
+    /**
+     * The per-phase histograms for a single opcode, or for one of the
+     * special purpose rows below.
+     */
+    struct OpcodeLatencies {
+        LatencyHistogram total;
+        LatencyHistogram serialize;
+        LatencyHistogram socket;
+        LatencyHistogram remote;
+    };
+
+    /**
+     * Format a `count, p50/p99/max` summary for one histogram.
+     */
+    static std::string format_histogram(const LatencyHistogram& histogram);
+
+    /**
+     * Dump a single opcode's histograms, if it has any recorded events.
+     */
+    void dump_latencies(Logger& logger,
+                        const std::string& name,
+                        const OpcodeLatencies& latencies,
+                        bool with_phases) const;
+
+    /**
+     * Histograms for `dispatch()` events and `audioMaster()` host callbacks,
+     * indexed by opcode. Out of range opcodes all share the last slot.
+     */
+    std::array<OpcodeLatencies, vst2_opcode_table_size> dispatch_latencies;
+    std::array<OpcodeLatencies, vst2_opcode_table_size> callback_latencies;
+
+    /**
+     * Timings for entire audio processing cycles and parameter round trips.
+     * These only use the `total` histogram.
+     */
+    OpcodeLatencies audio_processing_latencies;
+    OpcodeLatencies parameter_latencies;
+};
@@ -16,6 +16,71 @@
 
 #include "serialization.h"
 
+#include <sys/mman.h>
+#include <unistd.h>
+
+std::optional<ChunkMemfd> ChunkMemfd::copy_from(const uint8_t* data,
+                                                size_t size) noexcept {
+    const int fd = memfd_create("yabridge-chunk", MFD_CLOEXEC);
+    if (fd == -1) {
+        return std::nullopt;
+    }
+
+    size_t bytes_written = 0;
+    while (bytes_written < size) {
+        const ssize_t result =
+            write(fd, data + bytes_written, size - bytes_written);
+        if (result == -1) {
+            close(fd);
+            return std::nullopt;
+        }
+
+        bytes_written += result;
+    }
+
+    return ChunkMemfd{.size = size, .fd = fd};
+}
+
+bool ChunkMemfd::read_into(std::vector<uint8_t>& buffer) noexcept {
+    buffer.resize(size);
+
+    size_t bytes_read = 0;
+    while (bytes_read < size) {
+        const ssize_t result =
+            pread(fd, buffer.data() + bytes_read, size - bytes_read,
+                  bytes_read);
+        if (result <= 0) {
+            buffer.clear();
+            close(fd);
+            fd = -1;
+
+            return false;
+        }
+
+        bytes_read += result;
+    }
+
+    close(fd);
+    fd = -1;
+
+    return true;
+}
+
+void* ChunkMemfd::map() noexcept {
+    void* mapping = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+
+    // The mapping keeps a reference to the underlying file, so we can close
+    // the descriptor right away
+    close(fd);
+    fd = -1;
+
+    return mapping == MAP_FAILED ? nullptr : mapping;
+}
+
+void ChunkMemfd::unmap(void* mapping, size_t size) noexcept {
+    munmap(mapping, size);
+}
+
 DynamicVstEvents::DynamicVstEvents(const VstEvents& c_events)
     : events(c_events.numEvents) {
     // Copy from the C-style array into a vector for serialization
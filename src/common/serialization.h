@@ -25,8 +25,11 @@
 #include <bitsery/traits/vector.h>
 #include <vestige/aeffectx.h>
 
+#include <cassert>
+#include <cstring>
 #include <variant>
 
+#include "bitsery/ext/pod-vector.h"
 #include "vst24.h"
 
 // These constants are limits used by bitsery
@@ -42,6 +45,13 @@ constexpr size_t max_audio_channels = 16384;
  * The maximum number of samples in a buffer.
  */
 constexpr size_t max_buffer_size = 16384;
+/**
+ * The maximum number of parameter calls that can be coalesced into a single
+ * `ParameterBatch`. Hosts ramping automation will send a few dozen
+ * `setParameter()` calls per processing cycle at most, so this is only a
+ * safety limit.
+ */
+constexpr size_t max_parameter_batch_size = 16384;
 /**
  * The maximum number of MIDI events in a single `VstEvents` struct.
  */
@@ -60,6 +70,13 @@ constexpr size_t max_midi_events = max_buffer_size / sizeof(size_t);
  */
 constexpr size_t binary_buffer_size = 50 << 20;
 
+/**
+ * Chunks sent during `effGetChunk` and `effSetChunk` that are at least this
+ * large are transferred through a memfd passed over the socket instead of
+ * being serialized byte by byte. See `ChunkMemfd` for more details.
+ */
+constexpr size_t chunk_memfd_min_size = 1 << 20;
+
 // The plugin should always be compiled to a 64-bit version, but the host
 // application can also be 32-bit to allow using 32-bit legacy Windows VST in a
 // modern Linux VST host. Because of this we have to make sure to always use
@@ -202,8 +219,10 @@ class alignas(16) DynamicVstEvents {
 
     template <typename S>
     void serialize(S& s) {
-        s.container(events, max_midi_events,
-                    [](S& s, VstEvent& event) { s.container1b(event.dump); });
+        // `VstEvent` is just a fixed size dump of bytes, so the whole event
+        // list can be copied over the wire in a single block instead of
+        // serializing the events one at a time
+        s.ext(events, bitsery::ext::PodVector(max_midi_events));
     }
 
    private:
@@ -268,9 +287,7 @@ class alignas(16) DynamicSpeakerArrangement {
     template <typename S>
     void serialize(S& s) {
         s.value4b(flags);
-        s.container(
-            speakers, max_audio_channels,
-            [](S& s, VstSpeaker& speaker) { s.container1b(speaker.data); });
+        s.ext(speakers, bitsery::ext::PodVector(max_audio_channels));
     }
 
    private:
@@ -322,6 +339,67 @@ struct WantsVstTimeInfo {};
  */
 struct WantsString {};
 
+/**
+ * A large binary chunk for `effGetChunk` or `effSetChunk` that's transferred
+ * through an anonymous in-memory file instead of being part of the serialized
+ * message. Preset and bank chunks can approach `binary_buffer_size`, and
+ * serializing those byte by byte plus the extra copies on both ends would
+ * visibly stall the DAW when saving projects with multiple sampler instances.
+ * Only the chunk's size is part of the message. The file descriptor itself is
+ * passed out of band over the same Unix domain socket using `SCM_RIGHTS`
+ * ancillary data directly after the message announcing it, see `send_fd()`
+ * and `receive_fd()` in `communication.h`.
+ *
+ * The descriptor's ownership follows the data: the sending side closes it
+ * after passing it over the socket, and the receiving side closes it through
+ * `read_into()` or `map()`.
+ */
+struct ChunkMemfd {
+    /**
+     * Copy `size` bytes from `data` into a newly created memfd. Returns a
+     * nullopt when creating or writing the file fails, in which case the
+     * caller should fall back to serializing the chunk as a byte vector.
+     */
+    static std::optional<ChunkMemfd> copy_from(const uint8_t* data,
+                                               size_t size) noexcept;
+
+    /**
+     * Read the chunk into `buffer`, resizing it to fit, and close the file
+     * descriptor. Returns `false` and leaves `buffer` empty when reading
+     * fails.
+     */
+    bool read_into(std::vector<uint8_t>& buffer) noexcept;
+
+    /**
+     * Map the chunk into memory and close the file descriptor, since the
+     * mapping keeps the underlying file alive. Returns a null pointer when
+     * the mapping fails. The mapping should be released again with `unmap()`.
+     */
+    void* map() noexcept;
+
+    /**
+     * Release a mapping created by `map()`.
+     */
+    static void unmap(void* mapping, size_t size) noexcept;
+
+    /**
+     * The size of the chunk in bytes.
+     */
+    uint64_t size;
+
+    /**
+     * The file descriptor for the memfd in the current process. This is
+     * intentionally not serialized: it gets filled in on the receiving side
+     * after the descriptor has been passed over the socket.
+     */
+    int fd = -1;
+
+    template <typename S>
+    void serialize(S& s) {
+        s.value8b(size);
+    }
+};
+
 /**
  * VST events are passed a void pointer that can contain a variety of different
  * data types depending on the event's opcode. This is typically either:
@@ -373,7 +451,8 @@ using EventPayload = std::variant<std::nullptr_t,
                                   VstParameterProperties,
                                   WantsVstRect,
                                   WantsVstTimeInfo,
-                                  WantsString>;
+                                  WantsString,
+                                  ChunkMemfd>;
 
 template <typename S>
 void serialize(S& s, EventPayload& payload) {
@@ -397,6 +476,7 @@ void serialize(S& s, EventPayload& payload) {
               [](S& s, VstIOProperties& props) { s.object(props); },
               [](S& s, VstMidiKeyName& key_name) { s.object(key_name); },
               [](S& s, VstParameterProperties& props) { s.object(props); },
+              [](S& s, ChunkMemfd& chunk) { s.object(chunk); },
               [](S&, WantsAEffectUpdate&) {}, [](S&, WantsChunkBuffer&) {},
               [](S&, WantsVstRect&) {}, [](S&, WantsVstTimeInfo&) {},
               [](S&, WantsString&) {}});
@@ -467,7 +547,8 @@ using EventResultPayload = std::variant<std::nullptr_t,
                                         VstMidiKeyName,
                                         VstParameterProperties,
                                         VstRect,
-                                        VstTimeInfo>;
+                                        VstTimeInfo,
+                                        ChunkMemfd>;
 
 template <typename S>
 void serialize(S& s, EventResultPayload& payload) {
@@ -488,7 +569,8 @@ void serialize(S& s, EventResultPayload& payload) {
               [](S& s, VstMidiKeyName& key_name) { s.object(key_name); },
               [](S& s, VstParameterProperties& props) { s.object(props); },
               [](S& s, VstRect& rect) { s.object(rect); },
-              [](S& s, VstTimeInfo& time_info) { s.object(time_info); }});
+              [](S& s, VstTimeInfo& time_info) { s.object(time_info); },
+              [](S& s, ChunkMemfd& chunk) { s.object(chunk); }});
 }
 
 /**
@@ -511,6 +593,16 @@ struct EventResult {
      * `effGetSpeakerArrangement`.
      */
     std::optional<EventResultPayload> value_payload;
+    /**
+     * How long the receiving side spent actually handling the event, in
+     * microseconds. Only filled in when profiling is enabled on the receiving
+     * side, and zero otherwise. Echoing back a duration instead of timestamps
+     * means we don't have to care about the clocks in the two processes being
+     * comparable.
+     *
+     * @see EventProfiler
+     */
+    uint32_t handling_duration_us = 0;
 
     template <typename S>
     void serialize(S& s) {
@@ -519,6 +611,7 @@ struct EventResult {
         s.object(payload);
         s.ext(value_payload, bitsery::ext::StdOptional(),
               [](S& s, auto& v) { s.object(v); });
+        s.value4b(handling_duration_us);
     }
 };
 
@@ -553,45 +646,270 @@ struct ParameterResult {
     }
 };
 
+/**
+ * A batch of `getParameter` and `setParameter` calls sent over the
+ * `host_vst_parameters` socket in a single message. Hosts ramp automation by
+ * calling `setParameter()` dozens of times per processing cycle, and sending
+ * every one of those calls as its own round trip made this socket a
+ * bottleneck under heavy automation. The plugin side coalesces `setParameter`
+ * calls that come in while another parameter round trip is already in flight
+ * and then flushes them all at once.
+ */
+struct ParameterBatch {
+    std::vector<Parameter> parameters;
+
+    template <typename S>
+    void serialize(S& s) {
+        s.container(parameters, max_parameter_batch_size,
+                    [](S& s, auto& v) { s.object(v); });
+    }
+};
+
+/**
+ * The response to a `ParameterBatch`, containing one `ParameterResult` for
+ * every `Parameter` in the batch in the same order.
+ */
+struct ParameterBatchResult {
+    std::vector<ParameterResult> results;
+
+    template <typename S>
+    void serialize(S& s) {
+        s.container(results, max_parameter_batch_size,
+                    [](S& s, auto& v) { s.object(v); });
+    }
+};
+
 /**
  * A buffer of audio for the plugin to process, or the response of that
- * processing. The number of samples is encoded in each audio buffer's length.
- * This is used for both `process()/processReplacing()` and
+ * processing. This is used for both `process()/processReplacing()` and
  * `processDoubleReplacing()`.
+ *
+ * The audio is stored in a single flat, channel-strided buffer, i.e. channel
+ * `n` occupies elements `[n * sample_frames, (n + 1) * sample_frames)`. This
+ * way both sides can keep one persistent object whose buffer is reused across
+ * processing cycles and only ever grows, instead of performing a heap
+ * allocation per channel on the real-time thread for every block.
  */
 struct AudioBuffers {
     /**
-     * An audio buffer for each of the plugin's audio channels. This uses floats
-     * or doubles depending on whether `process()/processReplacing()` or
-     * `processDoubleReplacing()` got called.
+     * The audio for all of the plugin's audio channels, stored sequentially.
+     * This uses floats or doubles depending on whether
+     * `process()/processReplacing()` or `processDoubleReplacing()` got called.
+     *
+     * @see AudioBuffers::channel
+     */
+    std::variant<std::vector<float>, std::vector<double>> buffers;
+
+    /**
+     * The number of audio channels stored in `buffers`.
      */
-    std::variant<std::vector<std::vector<float>>,
-                 std::vector<std::vector<double>>>
-        buffers;
+    int num_channels;
 
     /**
-     * The number of frames in a sample. If buffers is not empty, then
-     * `buffers[0].size() == sample_frames`.
+     * The number of frames per channel, so
+     * `buffers.size() == num_channels * sample_frames`.
      */
     int sample_frames;
 
+    /**
+     * A snapshot of the host's `VstTimeInfo` taken just before this request
+     * was sent. Plugins commonly call `audioMasterGetTime()` once per
+     * processing cycle, and since the time info only changes in between
+     * blocks, sending it along with the audio lets the Wine VST host serve
+     * those calls locally instead of doing a socket round trip for each one.
+     * Unused (and left empty) on responses, and empty when the host does not
+     * support the callback.
+     */
+    std::optional<VstTimeInfo> time_info;
+
+    /**
+     * Set up the flat buffer to hold the given amount of audio, making sure
+     * the variant holds the right sample type. The buffer's backing allocation
+     * is reused between calls and only ever grows.
+     */
+    template <typename T>
+    std::vector<T>& resize_to(int new_num_channels, int new_sample_frames) {
+        if (!std::holds_alternative<std::vector<T>>(buffers)) {
+            buffers.template emplace<std::vector<T>>();
+        }
+
+        num_channels = new_num_channels;
+        sample_frames = new_sample_frames;
+
+        std::vector<T>& samples = std::get<std::vector<T>>(buffers);
+        samples.resize(static_cast<size_t>(num_channels) * sample_frames);
+
+        return samples;
+    }
+
+    /**
+     * A pointer to the start of an audio channel within the flat buffer.
+     */
+    template <typename T>
+    T* channel(int index) {
+        return std::get<std::vector<T>>(buffers).data() +
+               (static_cast<size_t>(index) * sample_frames);
+    }
+
     template <typename S>
     void serialize(S& s) {
-        s.ext(
-            buffers,
-            bitsery::ext::StdVariant{
-                [](S& s, std::vector<std::vector<float>>& buffer) {
-                    s.container(buffer, max_audio_channels, [](S& s, auto& v) {
-                        s.container4b(v, max_buffer_size);
-                    });
-                },
-                [](S& s, std::vector<std::vector<double>>& buffer) {
-                    s.container(buffer, max_audio_channels, [](S& s, auto& v) {
-                        s.container8b(v, max_buffer_size);
-                    });
-                },
-            });
+        // We can't use `bitsery::ext::StdVariant` here because then the wire
+        // format could not be mirrored exactly by `AudioBuffersOutput`'s
+        // deserializer below, so the sample type and the buffer sizes are
+        // encoded explicitly instead.
+        uint8_t double_precision =
+            std::holds_alternative<std::vector<double>>(buffers);
+        s.value1b(double_precision);
+
+        s.value4b(num_channels);
         s.value4b(sample_frames);
+        assert(static_cast<size_t>(num_channels) <= max_audio_channels &&
+               static_cast<size_t>(sample_frames) <= max_buffer_size);
+
+        s.ext(time_info, bitsery::ext::StdOptional(),
+              [](S& s, auto& v) { s.object(v); });
+
+        const auto serialize_buffers = [&](auto& samples) {
+            // Since the samples are just a flat array of floats or doubles
+            // they can be copied as a single block instead of being
+            // serialized one at a time. When deserializing this also resizes
+            // the vector to match the amount of received audio.
+            s.ext(samples,
+                  bitsery::ext::PodVector(max_audio_channels * max_buffer_size));
+            assert(samples.size() ==
+                   static_cast<size_t>(num_channels) * sample_frames);
+        };
+
+        if (double_precision) {
+            // When deserializing we have to make sure the variant contains the
+            // right alternative before we read into it
+            if (!std::holds_alternative<std::vector<double>>(buffers)) {
+                buffers.emplace<std::vector<double>>();
+            }
+
+            serialize_buffers(std::get<std::vector<double>>(buffers));
+        } else {
+            if (!std::holds_alternative<std::vector<float>>(buffers)) {
+                buffers.emplace<std::vector<float>>();
+            }
+
+            serialize_buffers(std::get<std::vector<float>>(buffers));
+        }
+    }
+};
+
+/**
+ * A deserialization-only counterpart to `AudioBuffers` that writes the
+ * incoming channel data directly into the `outputs` arrays the host handed us
+ * during `processReplacing()`. This mirrors the wire format produced by
+ * `AudioBuffers::serialize()` exactly, but the response buffers never exist as
+ * a separate allocation, which saves a full copy of every audio block on the
+ * real-time thread. Only used when the shared memory audio buffers are not
+ * active.
+ *
+ * @see AudioBuffers
+ * @see read_object_into
+ */
+template <typename T>
+struct AudioBuffersOutput {
+    /**
+     * The host's output channel pointers the audio should be written to. Not
+     * owned by this object.
+     */
+    T** outputs;
+
+    /**
+     * The number of channels in `outputs`, i.e. the plugin's reported number
+     * of output channels. The Wine VST host should be sending us exactly this
+     * many channels.
+     */
+    int num_channels;
+
+    /**
+     * The number of frames per channel in `outputs`, i.e. the block size the
+     * host passed to `processReplacing()`. The response should contain
+     * exactly this many frames.
+     */
+    int sample_frames;
+
+    /**
+     * Mirrors `AudioBuffers::time_info` so the wire formats stay identical.
+     * This is never set on responses, so deserializing it is a single flag
+     * byte.
+     */
+    std::optional<VstTimeInfo> time_info;
+
+    /**
+     * Whether the response matched the expected sample type, channel count,
+     * frame count, and payload size. When this is `false` after
+     * deserializing, nothing has been written to `outputs` and the caller
+     * should treat the response as a failed deserialization.
+     */
+    bool valid = false;
+
+    template <typename S>
+    void serialize(S& s) {
+        uint8_t double_precision = std::is_same_v<T, double>;
+        s.value1b(double_precision);
+
+        uint32_t received_channels = num_channels;
+        s.value4b(received_channels);
+        uint32_t received_frames = sample_frames;
+        s.value4b(received_frames);
+
+        s.ext(time_info, bitsery::ext::StdOptional(),
+              [](S& s, auto& v) { s.object(v); });
+
+        // The samples arrive as the single block of bytes written by
+        // `bitsery::ext::PodVector` in `AudioBuffers::serialize()` above, so
+        // whole channel rows can be copied out of it at once. This buffer is
+        // thread local for the same reason as the extension's staging buffer:
+        // the audio thread shouldn't allocate after the first few blocks.
+        thread_local std::vector<uint8_t> blob{};
+        s.container1b(
+            blob, max_audio_channels * max_buffer_size * sizeof(T));
+
+        // The sizes above came off the wire, so they cannot be trusted before
+        // writing through the host's `outputs` pointers. They can legitimately
+        // disagree with what we expect when the plugin changes its IO
+        // configuration mid-stream, since `audioMasterIOChanged()` travels
+        // over a different socket than the audio does, and a desynced or
+        // corrupt stream could contain anything. Copying based on mismatched
+        // sizes would corrupt the host's memory, so such a response gets
+        // dropped here and rejected by the caller instead.
+        valid = double_precision == (std::is_same_v<T, double> ? 1 : 0) &&
+                received_channels == static_cast<uint32_t>(num_channels) &&
+                received_frames == static_cast<uint32_t>(sample_frames) &&
+                blob.size() == static_cast<size_t>(received_channels) *
+                                   received_frames * sizeof(T);
+        if (!valid) {
+            return;
+        }
+
+        const size_t channel_size =
+            static_cast<size_t>(sample_frames) * sizeof(T);
+        for (int channel = 0; channel < num_channels; channel++) {
+            std::memcpy(outputs[channel], blob.data() + channel * channel_size,
+                        channel_size);
+        }
+    }
+};
+
+/**
+ * Sent by the Wine VST host as part of the startup process to indicate whether
+ * it was able to map the shared memory audio buffers created by the plugin. If
+ * either side could not set up the shared memory object, then both sides will
+ * fall back to sending `AudioBuffers` over the `host_vst_process_replacing`
+ * socket instead.
+ *
+ * @see AudioShmBuffer
+ */
+struct AudioShmStatus {
+    bool active;
+
+    template <typename S>
+    void serialize(S& s) {
+        s.value1b(active);
     }
 };
 
@@ -21,6 +21,27 @@
 #endif
 #include <boost/filesystem.hpp>
 
+#include <chrono>
+
+/**
+ * How long both sides of the audio processing round trip should spin before
+ * falling back to a blocking wait when `Configuration::low_latency_spin` is
+ * enabled. The Wine side usually responds within tens of microseconds, so
+ * this should cover almost every processing cycle without burning an
+ * unreasonable amount of CPU when the plugin takes longer.
+ */
+constexpr std::chrono::microseconds low_latency_spin_duration{100};
+
+/**
+ * Hint to the processor that we're in a spin loop so it can be a bit more
+ * power efficient and leave more resources for the other hyperthread.
+ */
+inline void cpu_pause() {
+#if defined(__i386__) || defined(__x86_64__)
+    __builtin_ia32_pause();
+#endif
+}
+
 /**
  * Return the path to the directory for story temporary files. This will be
  * `$XDG_RUNTIME_DIR` if set, and `/tmp` otherwise.
@@ -0,0 +1,206 @@
+// yabridge: a Wine VST bridge
+// Copyright (C) 2020  Robbert van der Helm
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#include "host-pool.h"
+
+#include <boost/process/env.hpp>
+#include <boost/process/io.hpp>
+
+#include "../common/communication.h"
+
+namespace bp = boost::process;
+namespace fs = boost::filesystem;
+
+using namespace std::literals::chrono_literals;
+
+/**
+ * Generate a path for the pool socket endpoint. This only has to be unique
+ * per process since every process gets its own pool, so we can simply use the
+ * PID.
+ */
+fs::path generate_pool_endpoint() {
+    return get_temporary_directory() /
+           ("yabridge-pool-" +
+            std::to_string(boost::this_process::get_id()) + ".sock");
+}
+
+HostProcessPool::HostProcessPool()
+    : io_context(SharedIoContext::instance()),
+      pool_endpoint(generate_pool_endpoint().string()),
+      pool_acceptor(io_context->context, pool_endpoint) {
+    accept_idle_hosts();
+}
+
+HostProcessPool::~HostProcessPool() {
+    // Cancel the accept loop and wait for the last handler to finish, since
+    // those handlers run on the shared IO context and touch this object
+    boost::system::error_code err;
+    pool_acceptor.close(err);
+    fs::remove(pool_endpoint.path());
+
+    std::unique_lock lock(pool_mutex);
+    pool_cv.wait(lock, [&]() { return !accept_loop_active; });
+
+    // Processes that were never claimed don't have anything to clean up, so
+    // they can just be killed
+    for (auto& [pid, spawning_host] : spawning_hosts) {
+        spawning_host.process.terminate();
+        spawning_host.process.wait();
+    }
+    for (auto& [key, idle] : idle_hosts) {
+        for (auto& idle_host : idle) {
+            idle_host.process.terminate();
+            idle_host.process.wait();
+        }
+    }
+}
+
+std::shared_ptr<HostProcessPool> HostProcessPool::instance() {
+    static std::mutex instance_mutex{};
+    static std::weak_ptr<HostProcessPool> weak_instance{};
+
+    std::lock_guard lock(instance_mutex);
+    std::shared_ptr<HostProcessPool> pool = weak_instance.lock();
+    if (!pool) {
+        pool = std::make_shared<HostProcessPool>();
+        weak_instance = pool;
+    }
+
+    return pool;
+}
+
+HostProcessPool::PooledHost HostProcessPool::claim(const fs::path& host_path,
+                                                   bp::environment host_env) {
+    // The Wine prefix has already been written to the environment by
+    // `set_wineprefix()` if the plugin is inside of one
+    std::string wine_prefix{};
+    if (const auto wine_prefix_envvar = host_env.find("WINEPREFIX");
+        wine_prefix_envvar != host_env.end()) {
+        wine_prefix = wine_prefix_envvar->to_string();
+    }
+
+    const PoolKey key{host_path.string(), wine_prefix};
+
+    std::unique_lock lock(pool_mutex);
+    std::deque<PooledHost>& idle = idle_hosts[key];
+
+    // Spawn enough processes so that after this claim there are still spare
+    // pre-warmed processes left for the next plugin instance
+    size_t num_starting = 0;
+    for (const auto& [pid, spawning_host] : spawning_hosts) {
+        if (spawning_host.key == key) {
+            num_starting += 1;
+        }
+    }
+    for (size_t num_available = idle.size() + num_starting;
+         num_available < host_pool_spare_processes + 1; num_available++) {
+        spawn_idle_host(key, host_env);
+    }
+
+    // On the first claim for this key we'll have to wait for one of the
+    // processes we just spawned to finish initializing Wine. While waiting
+    // we'll also check whether those processes are still alive, because if
+    // Wine fails to start they will exit without ever connecting to the pool
+    // and we would otherwise wait here indefinitely.
+    while (idle.empty()) {
+        bool any_starting = false;
+        for (auto it = spawning_hosts.begin(); it != spawning_hosts.end();) {
+            if (it->second.key != key) {
+                it++;
+            } else if (!it->second.process.running()) {
+                it = spawning_hosts.erase(it);
+            } else {
+                any_starting = true;
+                it++;
+            }
+        }
+
+        if (!any_starting) {
+            throw std::runtime_error(
+                "The Wine host process exited before it could connect to "
+                "the process pool, check the logs for Wine errors");
+        }
+
+        pool_cv.wait_for(lock, 100ms);
+    }
+
+    PooledHost host = std::move(idle.front());
+    idle.pop_front();
+
+    return host;
+}
+
+void HostProcessPool::spawn_idle_host(const PoolKey& key,
+                                      const bp::environment& host_env) {
+    patched_async_pipe stdout_pipe(io_context->context);
+    patched_async_pipe stderr_pipe(io_context->context);
+
+    // Passing only the pool socket path instead of a plugin and an endpoint
+    // directory tells `yabridge-host.exe` to start in pooled mode, where it
+    // connects to the pool and waits for a `GroupRequest`. We'll use vfork()
+    // here for the same file descriptor inheritance reasons as in
+    // `launch_host()`.
+    bp::child process(fs::path(key.first), pool_endpoint.path(),
+                      bp::posix::use_vfork, bp::env = host_env,
+                      bp::std_out = stdout_pipe, bp::std_err = stderr_pipe);
+
+    const pid_t pid = process.id();
+    spawning_hosts.emplace(
+        pid, SpawningHost{key, std::move(process), std::move(stdout_pipe),
+                          std::move(stderr_pipe)});
+}
+
+void HostProcessPool::accept_idle_hosts() {
+    pool_acceptor.async_accept(
+        [&](const boost::system::error_code& error,
+            boost::asio::local::stream_protocol::socket socket) {
+            // The accept only fails when the acceptor gets closed during the
+            // pool's teardown
+            if (error.failed()) {
+                std::lock_guard lock(pool_mutex);
+                accept_loop_active = false;
+                pool_cv.notify_all();
+
+                return;
+            }
+
+            // The connecting process identifies itself with its PID so we
+            // can match it to the `SpawningHost` entry created when it was
+            // spawned
+            try {
+                const auto response = read_object<GroupResponse>(socket);
+
+                std::lock_guard lock(pool_mutex);
+                if (const auto spawning_host =
+                        spawning_hosts.find(response.pid);
+                    spawning_host != spawning_hosts.end()) {
+                    idle_hosts[spawning_host->second.key].push_back(
+                        PooledHost{std::move(spawning_host->second.process),
+                                   std::move(spawning_host->second.stdout_pipe),
+                                   std::move(spawning_host->second.stderr_pipe),
+                                   std::move(socket)});
+                    spawning_hosts.erase(spawning_host);
+
+                    pool_cv.notify_all();
+                }
+            } catch (const boost::system::system_error&) {
+                // The host process died during the handshake, `claim()` will
+                // reap it
+            }
+
+            accept_idle_hosts();
+        });
+}
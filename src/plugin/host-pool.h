@@ -0,0 +1,204 @@
+// yabridge: a Wine VST bridge
+// Copyright (C) 2020  Robbert van der Helm
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#pragma once
+
+// Boost.Process's auto detection for vfork() support doesn't seem to work
+#define BOOST_POSIX_HAS_VFORK 1
+
+#include <boost/asio/local/stream_protocol.hpp>
+#include <boost/filesystem.hpp>
+#include <boost/process/child.hpp>
+#include <boost/process/environment.hpp>
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+
+#include "shared-io-context.h"
+#include "utils.h"
+
+/**
+ * The number of idle host processes the pool tries to keep around for a
+ * host application and Wine prefix combination once a plugin has requested a
+ * process for that combination. Starting `yabridge-host.exe` can take
+ * multiple seconds because the entire Wine environment has to come up before
+ * `main()` even runs, so when a project loads many instances of a plugin in
+ * quick succession these spares hide most of that cost.
+ */
+constexpr size_t host_pool_spare_processes = 2;
+
+/**
+ * A process wide pool of pre-warmed `yabridge-host.exe` processes, used when
+ * the `prewarm_hosts` option is enabled. These processes are spawned ahead of
+ * time with only a pool socket path as an argument. Once such a process has
+ * finished initializing Wine it connects back to the pool's socket,
+ * identifies itself with a `GroupResponse` and then blocks until it receives
+ * a `GroupRequest` telling it which plugin to load and which socket directory
+ * to connect to. That's the exact same handshake used by group host
+ * processes, but since every pooled process still hosts a single plugin the
+ * crash isolation of individual hosting is preserved.
+ *
+ * The pool is shared between all plugin instances within this process through
+ * `HostProcessPool::instance()`, just like `SharedIoContext`. Whenever a
+ * process gets claimed the pool spawns replacements in the background so the
+ * next instance doesn't have to wait for Wine to start. Idle processes exit
+ * on their own when their pool socket gets closed, which happens when the
+ * last plugin instance in this process unloads the library.
+ *
+ * @relates IndividualHost
+ */
+class HostProcessPool {
+   public:
+    /**
+     * A pre-warmed host process that has been claimed from the pool. The
+     * STDOUT and STDERR pipes were connected when the process was spawned and
+     * have not been read from yet, so the claiming `IndividualHost` can
+     * attach them to its own logger without losing any output.
+     */
+    struct PooledHost {
+        boost::process::child process;
+        patched_async_pipe stdout_pipe;
+        patched_async_pipe stderr_pipe;
+
+        /**
+         * The connection the idle host process made back to the pool. Writing
+         * a `GroupRequest` to this socket causes the process to load the
+         * plugin and connect to the plugin's socket endpoints.
+         */
+        boost::asio::local::stream_protocol::socket control_socket;
+    };
+
+    /**
+     * Set up the pool by listening on a new pool socket endpoint. Pooled host
+     * processes will connect to this endpoint once they're up and running.
+     * Use `instance()` instead of creating new objects directly.
+     *
+     * @throw boost::system::system_error If we can't listen on the socket.
+     */
+    HostProcessPool();
+
+    /**
+     * Terminate all processes that are still idling in the pool and remove
+     * the pool socket endpoint.
+     */
+    ~HostProcessPool();
+
+    HostProcessPool(const HostProcessPool&) = delete;
+    HostProcessPool& operator=(const HostProcessPool&) = delete;
+
+    /**
+     * Return the pool shared by all plugin instances within this process,
+     * creating it if this is the first instance asking for it. The pool gets
+     * torn down again when the last instance drops its reference.
+     */
+    static std::shared_ptr<HostProcessPool> instance();
+
+    /**
+     * Claim a pre-warmed host process for the given host application and
+     * environment, spawning new idle processes as needed so that there are
+     * spares left for the next plugin instance. The first claim for a host
+     * application and Wine prefix combination still has to wait for a freshly
+     * spawned process to finish starting Wine, but subsequent claims get an
+     * already initialized process handed to them.
+     *
+     * @param host_path The path to the host application to run, as returned
+     *   by `find_vst_host()`. Since 32-bit and 64-bit plugins use different
+     *   host applications this also encodes the plugin architecture.
+     * @param host_env The environment to spawn new host processes with. This
+     *   should be obtained from `set_wineprefix()`, and the `WINEPREFIX`
+     *   value is part of the key idle processes are matched on.
+     *
+     * @throw std::runtime_error If the spawned host process exits before it
+     *   manages to connect back to the pool, for instance when Wine fails to
+     *   start.
+     */
+    PooledHost claim(const boost::filesystem::path& host_path,
+                     boost::process::environment host_env);
+
+   private:
+    /**
+     * Idle host processes are matched on the host application that was
+     * started and the Wine prefix it was started under, since a process can
+     * only load plugins for its own architecture and prefix.
+     */
+    using PoolKey = std::pair<std::string, std::string>;
+
+    /**
+     * A host process that has been spawned but that has not yet connected
+     * back to the pool socket.
+     */
+    struct SpawningHost {
+        PoolKey key;
+        boost::process::child process;
+        patched_async_pipe stdout_pipe;
+        patched_async_pipe stderr_pipe;
+    };
+
+    /**
+     * Spawn a new idle host process for the given key. Must be called while
+     * holding `pool_mutex`.
+     */
+    void spawn_idle_host(const PoolKey& key,
+                         const boost::process::environment& host_env);
+
+    /**
+     * Asynchronously listen on the pool socket for host processes that have
+     * finished initializing. Every connecting process sends a `GroupResponse`
+     * with its PID first so it can be matched to the `SpawningHost` entry it
+     * was spawned as, after which it gets moved to `idle_hosts`.
+     */
+    void accept_idle_hosts();
+
+    /**
+     * The shared IO context the pool socket and the STDIO pipes of spawned
+     * processes are created on. Keeping a reference here makes sure the
+     * context outlives the pool.
+     */
+    std::shared_ptr<SharedIoContext> io_context;
+
+    boost::asio::local::stream_protocol::endpoint pool_endpoint;
+    boost::asio::local::stream_protocol::acceptor pool_acceptor;
+
+    /**
+     * Processes that have been spawned but that are still starting up,
+     * indexed by their PID.
+     */
+    std::map<pid_t, SpawningHost> spawning_hosts;
+
+    /**
+     * Fully initialized processes that are waiting to be claimed, per host
+     * application and Wine prefix.
+     */
+    std::map<PoolKey, std::deque<PooledHost>> idle_hosts;
+
+    /**
+     * Protects `spawning_hosts` and `idle_hosts`. The condition variable gets
+     * notified whenever a process moves to `idle_hosts` so `claim()` can wake
+     * up.
+     */
+    std::mutex pool_mutex;
+    std::condition_variable pool_cv;
+
+    /**
+     * Whether the accept handler posted by `accept_idle_hosts()` is still
+     * rearming itself. Since those handlers run on the shared IO context, the
+     * destructor has to wait for the last one to finish before the pool can
+     * be torn down.
+     */
+    bool accept_loop_active = true;
+};
@@ -16,6 +16,10 @@
 
 #include "host-process.h"
 
+#include <poll.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
 #include <boost/asio/read_until.hpp>
 #include <boost/process/env.hpp>
 #include <boost/process/io.hpp>
@@ -66,6 +70,32 @@ HostProcess::HostProcess(boost::asio::io_context& io_context, Logger& logger)
     async_log_pipe_lines(stderr_pipe, stderr_buffer, "[Wine STDERR] ");
 }
 
+HostProcess::HostProcess(Logger& logger,
+                         patched_async_pipe stdout_pipe,
+                         patched_async_pipe stderr_pipe)
+    : stdout_pipe(std::move(stdout_pipe)),
+      stderr_pipe(std::move(stderr_pipe)),
+      logger(logger) {
+    // Same as above, except that the pipes were already connected when the
+    // pooled process was spawned. Any output the process produced while it
+    // was idling is still sitting in the pipes and will be logged now.
+    async_log_pipe_lines(this->stdout_pipe, stdout_buffer, "[Wine STDOUT] ");
+    async_log_pipe_lines(this->stderr_pipe, stderr_buffer, "[Wine STDERR] ");
+}
+
+void HostProcess::close_stdio() {
+    boost::system::error_code err;
+    stdout_pipe.close(err);
+    stderr_pipe.close(err);
+
+    // The handlers for any still pending reads will now finish with an error,
+    // and we have to wait for that to happen before this object can be
+    // destroyed
+    std::unique_lock lock(active_pipe_readers_mutex);
+    active_pipe_readers_cv.wait(lock,
+                                [&]() { return active_pipe_readers == 0; });
+}
+
 void HostProcess::async_log_pipe_lines(patched_async_pipe& pipe,
                                        boost::asio::streambuf& buffer,
                                        std::string prefix) {
@@ -75,6 +105,10 @@ void HostProcess::async_log_pipe_lines(patched_async_pipe& pipe,
             // When we get an error code then that likely means that the pipe
             // has been clsoed and we have reached the end of the file
             if (error.failed()) {
+                std::lock_guard lock(active_pipe_readers_mutex);
+                active_pipe_readers -= 1;
+                active_pipe_readers_cv.notify_all();
+
                 return;
             }
 
@@ -116,6 +150,41 @@ IndividualHost::IndividualHost(boost::asio::io_context& io_context,
 #endif
 }
 
+IndividualHost::IndividualHost(boost::asio::io_context& /*io_context*/,
+                               Logger& logger,
+                               fs::path plugin_path,
+                               const Sockets<std::jthread>& sockets,
+                               std::shared_ptr<HostProcessPool> host_pool)
+    // The claim will block until a pre-warmed process is available. On the
+    // first claim for this plugin's architecture and Wine prefix that still
+    // involves waiting for Wine to start, but the pool will have spare
+    // processes ready for any subsequent plugin instances.
+    : IndividualHost(
+          logger,
+          plugin_path,
+          sockets,
+          host_pool->claim(
+              find_vst_host(find_vst_architecture(plugin_path), false),
+              set_wineprefix())) {}
+
+IndividualHost::IndividualHost(Logger& logger,
+                               fs::path plugin_path,
+                               const Sockets<std::jthread>& sockets,
+                               HostProcessPool::PooledHost pooled_host)
+    : HostProcess(logger,
+                  std::move(pooled_host.stdout_pipe),
+                  std::move(pooled_host.stderr_pipe)),
+      plugin_arch(find_vst_architecture(plugin_path)),
+      host_path(find_vst_host(plugin_arch, false)),
+      host(std::move(pooled_host.process)) {
+    // This is the same handshake a group host process receives, except that
+    // the pooled process already sent its PID when it connected to the pool
+    write_object(
+        pooled_host.control_socket,
+        GroupRequest{.plugin_path = plugin_path.string(),
+                     .endpoint_base_dir = sockets.base_dir.string()});
+}
+
 PluginArchitecture IndividualHost::architecture() {
     return plugin_arch;
 }
@@ -128,6 +197,10 @@ bool IndividualHost::running() {
     return host.running();
 }
 
+std::optional<pid_t> IndividualHost::pid() {
+    return host.id();
+}
+
 void IndividualHost::terminate() {
     host.terminate();
     host.wait();
@@ -175,7 +248,7 @@ GroupHost::GroupHost(boost::asio::io_context& io_context,
     const fs::path endpoint_base_dir = sockets.base_dir;
     const fs::path group_socket_path =
         generate_group_endpoint(group_name, wine_prefix, plugin_arch);
-    const auto connect = [&io_context, plugin_path, endpoint_base_dir,
+    const auto connect = [this, &io_context, plugin_path, endpoint_base_dir,
                           group_socket_path]() {
         boost::asio::local::stream_protocol::socket group_socket(io_context);
         group_socket.connect(group_socket_path.string());
@@ -186,6 +259,10 @@ GroupHost::GroupHost(boost::asio::io_context& io_context,
                          .endpoint_base_dir = endpoint_base_dir.string()});
         const auto response = read_object<GroupResponse>(group_socket);
         assert(response.pid > 0);
+
+        // The host guard in `PluginBridge` can use this PID to watch for
+        // crashes during the plugin's initialization
+        active_group_host_pid.store(response.pid);
     };
 
     try {
@@ -207,13 +284,38 @@ GroupHost::GroupHost(boost::asio::io_context& io_context,
                           endpoint_base_dir, group_host_pid]() {
                 using namespace std::literals::chrono_literals;
 
-                // We'll first try to connect to the group host we just spawned
+                // We'll first try to connect to the group host we just
+                // spawned. With a pidfd the sleep between connection attempts
+                // doubles as the exit check, so we don't have to inspect
+                // `/proc` on every iteration and we notice the process dying
+                // immediately. Old kernels without `pidfd_open()` keep the
+                // polling behavior.
                 // TODO: Replace this polling with inotify
-                while (pid_running(group_host_pid)) {
-                    std::this_thread::sleep_for(20ms);
+                int group_host_pidfd = -1;
+#ifdef SYS_pidfd_open
+                group_host_pidfd = static_cast<int>(
+                    syscall(SYS_pidfd_open, group_host_pid, 0));
+#endif
+
+                bool group_host_exited = false;
+                while (!group_host_exited) {
+                    if (group_host_pidfd >= 0) {
+                        // The pidfd becomes readable once the process exits
+                        pollfd group_host_poll{.fd = group_host_pidfd,
+                                               .events = POLLIN,
+                                               .revents = 0};
+                        group_host_exited =
+                            poll(&group_host_poll, 1, 20) > 0;
+                    } else {
+                        std::this_thread::sleep_for(20ms);
+                        group_host_exited = !pid_running(group_host_pid);
+                    }
 
                     try {
                         connect();
+                        if (group_host_pidfd >= 0) {
+                            close(group_host_pidfd);
+                        }
                         return;
                     } catch (const boost::system::system_error&) {
                         // Keep trying to connect until either connection gets
@@ -221,6 +323,10 @@ GroupHost::GroupHost(boost::asio::io_context& io_context,
                     }
                 }
 
+                if (group_host_pidfd >= 0) {
+                    close(group_host_pidfd);
+                }
+
                 // When the group host exits before we can connect to it this
                 // either means that there has been some kind of error (for
                 // instance related to Wine), or that another process was able
@@ -250,6 +356,15 @@ bool GroupHost::running() {
     return !startup_failed;
 }
 
+std::optional<pid_t> GroupHost::pid() {
+    const pid_t group_host_pid = active_group_host_pid.load();
+    if (group_host_pid > 0) {
+        return group_host_pid;
+    }
+
+    return std::nullopt;
+}
+
 void GroupHost::terminate() {
     // There's no need to manually terminate group host processes as they will
     // shut down automatically after all plugins have exited. Manually closing
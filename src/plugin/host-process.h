@@ -23,10 +23,13 @@
 #include <boost/asio/streambuf.hpp>
 #include <boost/filesystem.hpp>
 #include <boost/process/child.hpp>
+#include <condition_variable>
+#include <mutex>
 #include <thread>
 
 #include "../common/communication.h"
 #include "../common/logging.h"
+#include "host-pool.h"
 #include "utils.h"
 
 /**
@@ -58,11 +61,29 @@ class HostProcess {
      */
     virtual bool running() = 0;
 
+    /**
+     * Return the PID of the Wine process that's hosting the plugin, if it is
+     * known. For group hosts this is only known after an existing group
+     * process has accepted our host request, since a freshly spawned group
+     * process may lose the race to listen on the group socket to another
+     * process. Used to watch for host crashes during startup through a pidfd.
+     */
+    virtual std::optional<pid_t> pid() = 0;
+
     /**
      * Kill the process or cause the plugin that's being hosted to exit.
      */
     virtual void terminate() = 0;
 
+    /**
+     * Close the STDOUT and STDERR pipes and wait until their asynchronous
+     * read handlers have finished. Since those handlers run on the IO context
+     * shared by all plugin instances in this process, this has to be called
+     * before destroying a `HostProcess` or the handlers could still touch
+     * this object afterwards.
+     */
+    void close_stdio();
+
    protected:
     /**
      * Initialize the host process by setting up the STDIO redirection.
@@ -74,6 +95,20 @@ class HostProcess {
      */
     HostProcess(boost::asio::io_context& io_context, Logger& logger);
 
+    /**
+     * Initialize the host process around the STDIO pipes of an already
+     * spawned process, as claimed from a `HostProcessPool`. The pipes will
+     * not have been read from yet, so no output gets lost.
+     *
+     * @param logger The `Logger` instance the redirected STDIO streams will be
+     *   written to.
+     * @param stdout_pipe The pipe connected to the process's STDOUT stream.
+     * @param stderr_pipe The pipe connected to the process's STDERR stream.
+     */
+    HostProcess(Logger& logger,
+                patched_async_pipe stdout_pipe,
+                patched_async_pipe stderr_pipe);
+
     /**
      * The STDOUT stream of the Wine process we can forward to the logger.
      */
@@ -103,6 +138,15 @@ class HostProcess {
 
     boost::asio::streambuf stdout_buffer;
     boost::asio::streambuf stderr_buffer;
+
+    /**
+     * The number of pipe read handlers that are still rearming themselves.
+     * Decremented when a handler stops because its pipe got closed, so
+     * `close_stdio()` knows when it's safe to tear the object down.
+     */
+    int active_pipe_readers = 2;
+    std::mutex active_pipe_readers_mutex;
+    std::condition_variable active_pipe_readers_cv;
 };
 
 /**
@@ -129,12 +173,48 @@ class IndividualHost : public HostProcess {
                    boost::filesystem::path plugin_path,
                    const Sockets<std::jthread>& sockets);
 
+    /**
+     * Claim a pre-warmed host process from the pool instead of spawning a new
+     * one, and ask it to load the plugin and to connect back to this yabridge
+     * instance over the specified socket. Used when the `prewarm_hosts`
+     * option is enabled.
+     *
+     * @param io_context The IO context that the STDIO redurection will be
+     *   handled on.
+     * @param logger The `Logger` instance the redirected STDIO streams will be
+     *   written to.
+     * @param sockets The socket endpoints that will be used for communication
+     *   with the plugin.
+     * @param host_pool The pool shared by all plugin instances within this
+     *   process.
+     *
+     * @throw std::runtime_error When `plugin_path` does not point to a valid
+     *   32-bit or 64-bit .dll file, or when the pool's host process failed to
+     *   start.
+     */
+    IndividualHost(boost::asio::io_context& io_context,
+                   Logger& logger,
+                   boost::filesystem::path plugin_path,
+                   const Sockets<std::jthread>& sockets,
+                   std::shared_ptr<HostProcessPool> host_pool);
+
     PluginArchitecture architecture() override;
     boost::filesystem::path path() override;
     bool running() override;
+    std::optional<pid_t> pid() override;
     void terminate() override;
 
    private:
+    /**
+     * The delegation target for the pool based constructor above. Claiming
+     * has to happen in a delegating constructor since the pipes of the
+     * claimed process are needed to initialize the `HostProcess` base class.
+     */
+    IndividualHost(Logger& logger,
+                   boost::filesystem::path plugin_path,
+                   const Sockets<std::jthread>& sockets,
+                   HostProcessPool::PooledHost pooled_host);
+
     PluginArchitecture plugin_arch;
     boost::filesystem::path host_path;
     boost::process::child host;
@@ -175,12 +255,21 @@ class GroupHost : public HostProcess {
     PluginArchitecture architecture() override;
     boost::filesystem::path path() override;
     bool running() override;
+    std::optional<pid_t> pid() override;
     void terminate() override;
 
    private:
     PluginArchitecture plugin_arch;
     boost::filesystem::path host_path;
 
+    /**
+     * The PID of the group host process that has accepted our host request,
+     * as reported in its `GroupResponse`. This stays at zero until the
+     * request has been accepted, which may happen from the connect handler
+     * thread below.
+     */
+    std::atomic<pid_t> active_group_host_pid = 0;
+
     /**
      * We want to either connect to an existing group host process, or spawn a
      * new one. This can result in some interesting scenarios when multiple
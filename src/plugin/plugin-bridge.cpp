@@ -16,11 +16,16 @@
 
 #include "plugin-bridge.h"
 
+#include <sys/syscall.h>
+#include <unistd.h>
+
 // Generated inside of the build directory
 #include <src/common/config/config.h>
 #include <src/common/config/version.h>
 
 #include "../common/communication.h"
+#include "../common/opcode-traits.h"
+#include "../common/profiling.h"
 #include "../common/utils.h"
 #include "utils.h"
 
@@ -29,6 +34,23 @@ namespace bp = boost::process;
 // boost::filesystem
 namespace fs = boost::filesystem;
 
+/**
+ * How often `PluginBridge::refresh_parameter_cache()` will actually refresh
+ * the parameter cache. Hosts poll `getParameter()` at frame rate, so anything
+ * in this ballpark turns thousands of round trips per second into ten.
+ */
+constexpr std::chrono::milliseconds parameter_cache_refresh_interval{100};
+
+/**
+ * The `audioMasterGetTime()` filter bits for all of the optional `VstTimeInfo`
+ * fields (nanoseconds, PPQ position, tempo, bars, cycle position, time
+ * signature, SMPTE and clock validity). Used when taking the per-block time
+ * info snapshot so the snapshot can answer any field a plugin might ask for.
+ * These constants are not defined in `vestige/aeffectx.h`, but they are
+ * documented at http://www.asseca.org/vst-24-specs/amGetTime.html.
+ */
+constexpr intptr_t time_info_all_fields = 0xff00;
+
 intptr_t dispatch_proxy(AEffect*, int, int, intptr_t, void*, float);
 void process_proxy(AEffect*, float**, float**, int);
 void process_replacing_proxy(AEffect*, float**, float**, int);
@@ -52,61 +74,117 @@ PluginBridge::PluginBridge(audioMasterCallback host_callback)
       // `Vst2PluginInstance::vstAudioMasterCallback` from Bitwig's plugin
       // bridge will crash otherwise
       plugin(),
-      io_context(),
-      sockets(io_context,
+      io_context(SharedIoContext::instance()),
+      sockets(io_context->context,
               generate_endpoint_base(
                   vst_plugin_path.filename().replace_extension("").string()),
-              true),
+              true,
+              config.single_endpoint),
       host_callback_function(host_callback),
       logger(Logger::create_from_environment(
           create_logger_prefix(sockets.base_dir))),
       wine_version(get_wine_version()),
       vst_host(config.group
                    ? std::unique_ptr<HostProcess>(
-                         std::make_unique<GroupHost>(io_context,
+                         std::make_unique<GroupHost>(io_context->context,
                                                      logger,
                                                      vst_plugin_path,
                                                      sockets,
                                                      *config.group))
+#ifndef WITH_WINEDBG
+               // The pool spawns its processes directly, so it can't wrap
+               // them in winedbg
+               : config.prewarm_hosts
+                   ? std::unique_ptr<HostProcess>(
+                         std::make_unique<IndividualHost>(
+                             io_context->context,
+                             logger,
+                             vst_plugin_path,
+                             sockets,
+                             HostProcessPool::instance()))
+#endif
                    : std::unique_ptr<HostProcess>(
-                         std::make_unique<IndividualHost>(io_context,
+                         std::make_unique<IndividualHost>(io_context->context,
                                                           logger,
                                                           vst_plugin_path,
                                                           sockets))),
-      has_realtime_priority(set_realtime_priority()),
-      wine_io_handler([&]() { io_context.run(); }) {
+      has_realtime_priority(set_realtime_priority()) {
     log_init_message();
 
 #ifndef WITH_WINEDBG
     // If the Wine process fails to start, then nothing will connect to the
-    // sockets and we'll be hanging here indefinitely. To prevent this, we'll
-    // periodically poll whether the Wine process is still running, and throw
-    // when it is not. The alternative would be to rewrite this to using
-    // `async_accept`, Boost.Asio timers, and another IO context, but I feel
-    // like this a much simpler solution.
-    host_guard_handler = std::jthread([&](std::stop_token st) {
-        using namespace std::literals::chrono_literals;
-
-        while (!st.stop_requested()) {
-            if (!vst_host->running()) {
-                logger.log(
-                    "The Wine host process has exited unexpectedly. Check the "
-                    "output above for more information.");
-                std::terminate();
-            }
-
-            std::this_thread::sleep_for(20ms);
+    // sockets and we'll be hanging here indefinitely. To prevent this we
+    // watch the Wine process during startup and terminate when it exits.
+    // When the host's PID is already known we register a pidfd on the shared
+    // IO context, which wakes us up the moment the process exits without any
+    // polling. On kernels without `pidfd_open()`, and for freshly spawned
+    // group host processes whose actual host PID is not known yet, we fall
+    // back to polling the process's status on a timer.
+    host_guard_timer.emplace(io_context->context);
+    host_guard_active.store(true);
+#ifdef SYS_pidfd_open
+    if (const std::optional<pid_t> host_pid = vst_host->pid()) {
+        const int pidfd =
+            static_cast<int>(syscall(SYS_pidfd_open, *host_pid, 0));
+        if (pidfd >= 0) {
+            host_guard_pidfd.emplace(io_context->context, pidfd);
+            host_guard_pidfd->async_wait(
+                boost::asio::posix::stream_descriptor::wait_read,
+                [&](const boost::system::error_code& error) {
+                    // The `host_guard_active` check covers the race where the
+                    // process exits right as the sockets get connected
+                    if (error.failed() || !host_guard_active.load()) {
+                        return;
+                    }
+
+                    // The pidfd becoming readable means that the process has
+                    // exited. A group host process can still exit
+                    // legitimately when another process wins the race to
+                    // listen on the group socket, so when the host is not
+                    // considered dead we'll fall back to the polling check.
+                    if (!vst_host->running()) {
+                        logger.log(
+                            "The Wine host process has exited unexpectedly. "
+                            "Check the output above for more information.");
+                        std::terminate();
+                    }
+
+                    schedule_host_guard_check();
+                });
         }
-    });
+    }
+#endif
+    if (!host_guard_pidfd) {
+        schedule_host_guard_check();
+    }
 #endif
 
     // This will block until all sockets have been connected to by the Wine VST
     // host
     sockets.connect();
 #ifndef WITH_WINEDBG
-    host_guard_handler.request_stop();
+    host_guard_active.store(false);
+    if (host_guard_pidfd) {
+        host_guard_pidfd->cancel();
+    }
+    host_guard_timer->cancel();
 #endif
 
+    // Try to set up the shared memory audio buffers. The Wine VST host will
+    // attempt to map this same file after it receives our configuration, and
+    // it will then tell us whether it succeeded. If either side fails here
+    // we'll fall back to sending the audio buffers over the process replacing
+    // socket. Since we remove the file again when the creation fails, the Wine
+    // VST host can never end up mapping a half initialized buffer.
+    try {
+        audio_shm.emplace(sockets.base_dir / audio_shm_filename, true);
+    } catch (const std::system_error& error) {
+        logger.log(
+            "Could not create the shared memory audio buffers, falling back "
+            "to socket based audio processing:");
+        logger.log(error.what());
+    }
+
     // Set up all pointers for our `AEffect` struct. We will fill this with data
     // from the VST plugin loaded in Wine at the end of this constructor.
     plugin.ptr3 = this;
@@ -130,10 +208,19 @@ PluginBridge::PluginBridge(audioMasterCallback host_callback)
                 // them. Because of this we'll temporarily save any MIDI events
                 // we receive here, and then we'll actually send them to the
                 // host at the end of the `process_replacing()` function.
-                if (event.opcode == audioMasterProcessEvents) {
-                    std::lock_guard lock(incoming_midi_events_mutex);
+                // When the parameter cache is enabled we'll use these
+                // callbacks to keep it up to date in between the periodic
+                // bulk refreshes, since they're sent whenever the plugin
+                // changes a parameter from its own editor
+                if (event.opcode == audioMasterAutomate && event.index >= 0 &&
+                    static_cast<size_t>(event.index) <
+                        parameter_cache.size()) {
+                    parameter_cache[event.index].store(
+                        event.option, std::memory_order_relaxed);
+                }
 
-                    incoming_midi_events.push_back(
+                if (event.opcode == audioMasterProcessEvents) {
+                    incoming_midi_events.push(
                         std::get<DynamicVstEvents>(event.payload));
                     EventResult response{.return_value = 1,
                                          .payload = nullptr,
@@ -161,9 +248,64 @@ PluginBridge::PluginBridge(audioMasterCallback host_callback)
     // back to complete the startup process
     sockets.host_vst_control.send(config);
 
+    // The Wine VST host will have tried to map the shared memory audio buffers
+    // we created above after it received the configuration. If it could not do
+    // so we'll also fall back to the socket based audio processing so both
+    // sides stay in sync.
+    const auto shm_status =
+        sockets.host_vst_control.receive_single<AudioShmStatus>();
+    if (!shm_status.active && audio_shm) {
+        logger.log(
+            "The Wine host process could not map the shared memory audio "
+            "buffers, falling back to socket based audio processing");
+        audio_shm.reset();
+    }
+
+    // When enabled, the audio processing round trip will spin for a bit
+    // before blocking so we don't pay for a scheduler wakeup on every block
+    if (config.low_latency_spin) {
+        if (audio_shm) {
+            audio_shm->set_spin_duration(low_latency_spin_duration);
+        }
+        sockets.host_vst_process_replacing.set_spin_duration(
+            low_latency_spin_duration);
+    }
+
+    // When enabled, `getParameter()` calls will be answered from this cache
+    // instead of each being their own round trip. The cache gets filled
+    // lazily on the first `get_parameter()` call, so we don't query a plugin
+    // that the host hasn't opened yet.
+    if (config.cache_parameters && initialized_plugin.numParams > 0) {
+        parameter_cache = std::vector<std::atomic<float>>(
+            static_cast<size_t>(initialized_plugin.numParams));
+    }
+
     update_aeffect(plugin, initialized_plugin);
 }
 
+void PluginBridge::schedule_host_guard_check() {
+    using namespace std::literals::chrono_literals;
+
+    host_guard_timer->expires_after(20ms);
+    host_guard_timer->async_wait([&](const boost::system::error_code& error) {
+        // The `host_guard_active` check covers the race where the timer fires
+        // right as the sockets get connected, in which case the `cancel()`
+        // would come too late to stop the handler from running
+        if (error.failed() || !host_guard_active.load()) {
+            return;
+        }
+
+        if (!vst_host->running()) {
+            logger.log(
+                "The Wine host process has exited unexpectedly. Check the "
+                "output above for more information.");
+            std::terminate();
+        }
+
+        schedule_host_guard_check();
+    });
+}
+
 class DispatchDataConverter : DefaultDataConverter {
    public:
     DispatchDataConverter(std::vector<uint8_t>& chunk_data,
@@ -176,71 +318,72 @@ class DispatchDataConverter : DefaultDataConverter {
                       const intptr_t value,
                       const void* data) const override {
         // There are some events that need specific structs that we can't simply
-        // serialize as a string because they might contain null bytes
-        switch (opcode) {
-            case effOpen:
+        // serialize as a string because they might contain null bytes. The
+        // classification lives in the opcode traits table shared with the Wine
+        // host, so this switch only has to handle the payload kinds.
+        switch (dispatch_opcode_traits(opcode).payload) {
+            case Vst2PayloadKind::wants_aeffect_update:
                 // This should not be needed, but some improperly coded plugins
                 // such as the Roland Cloud plugins will initialize part of
                 // their `AEffect` only after the host calls `effOpen`, instead
                 // of during the initialization.
                 return WantsAEffectUpdate{};
                 break;
-            case effEditGetRect:
+            case Vst2PayloadKind::wants_vst_rect:
                 return WantsVstRect();
                 break;
-            case effEditOpen:
+            case Vst2PayloadKind::native_window_handle:
                 // The host will have passed us an X11 window handle in the void
                 // pointer. In the Wine VST host we'll create a Win32 window,
                 // ask the plugin to embed itself in that and then embed that
                 // window into this X11 window handle.
                 return reinterpret_cast<size_t>(data);
                 break;
-            case effGetChunk:
+            case Vst2PayloadKind::wants_chunk_buffer:
                 return WantsChunkBuffer();
                 break;
-            case effSetChunk: {
+            case Vst2PayloadKind::chunk: {
                 const uint8_t* chunk_data = static_cast<const uint8_t*>(data);
 
                 // When the host passes a chunk it will use the value parameter
-                // to tell us its length
+                // to tell us its length. Large chunks are moved through a
+                // memfd that gets passed over the socket so they don't have to
+                // be serialized byte by byte, with the byte vector as a
+                // fallback in case creating the memfd fails.
+                if (static_cast<size_t>(value) >= chunk_memfd_min_size) {
+                    if (auto memfd = ChunkMemfd::copy_from(chunk_data, value)) {
+                        return *memfd;
+                    }
+                }
+
                 return std::vector<uint8_t>(chunk_data, chunk_data + value);
             } break;
-            case effProcessEvents:
+            case Vst2PayloadKind::midi_events:
                 return DynamicVstEvents(*static_cast<const VstEvents*>(data));
                 break;
-            case effGetInputProperties:
-            case effGetOutputProperties:
+            case Vst2PayloadKind::io_properties:
                 // In this case we can't simply pass an empty marker struct
                 // because the host can have already populated this field with
                 // data (or at least Bitwig does this)
                 return *static_cast<const VstIOProperties*>(data);
                 break;
-            case effGetParameterProperties:
+            case Vst2PayloadKind::parameter_properties:
                 return *static_cast<const VstParameterProperties*>(data);
                 break;
-            case effGetMidiKeyName:
+            case Vst2PayloadKind::midi_key_name:
                 return *static_cast<const VstMidiKeyName*>(data);
                 break;
-            case effSetSpeakerArrangement:
-            case effGetSpeakerArrangement:
+            case Vst2PayloadKind::speaker_arrangement:
                 // This is the output speaker configuration, the `read_value()`
                 // method below reads the input speaker configuration
                 return DynamicSpeakerArrangement(
                     *static_cast<const VstSpeakerArrangement*>(data));
                 break;
             // Any VST host I've encountered has properly zeroed out these their
-            // string buffers, but we'll add a list of opcodes that should
-            // return a string just in case `DefaultDataConverter::read()` can't
-            // figure it out.
-            case effGetProgramName:
-            case effGetParamLabel:
-            case effGetParamDisplay:
-            case effGetParamName:
-            case effGetProgramNameIndexed:
-            case effGetEffectName:
-            case effGetVendorString:
-            case effGetProductString:
-            case effShellGetNextPlugin:
+            // string buffers, but the traits table lists all opcodes that
+            // should return a string just in case
+            // `DefaultDataConverter::read()` can't figure it out.
+            case Vst2PayloadKind::wants_string:
                 return WantsString{};
                 break;
             default:
@@ -252,29 +395,25 @@ class DispatchDataConverter : DefaultDataConverter {
     std::optional<EventPayload> read_value(
         const int opcode,
         const intptr_t value) const override {
-        switch (opcode) {
-            case effSetSpeakerArrangement:
-            case effGetSpeakerArrangement:
-                // These two events are special in that they pass a pointer to
-                // the output speaker configuration through the `data`
-                // parameter, but then they also pass a pointer to the input
-                // speaker configuration through the `value` parameter. This is
-                // the only event that does this.
-                return DynamicSpeakerArrangement(
-                    *static_cast<const VstSpeakerArrangement*>(
-                        reinterpret_cast<void*>(value)));
-                break;
-            default:
-                return DefaultDataConverter::read_value(opcode, value);
-                break;
+        if (dispatch_opcode_traits(opcode).value_payload) {
+            // The speaker arrangement events are special in that they pass a
+            // pointer to the output speaker configuration through the `data`
+            // parameter, but then they also pass a pointer to the input
+            // speaker configuration through the `value` parameter. These are
+            // the only events that do this.
+            return DynamicSpeakerArrangement(
+                *static_cast<const VstSpeakerArrangement*>(
+                    reinterpret_cast<void*>(value)));
         }
+
+        return DefaultDataConverter::read_value(opcode, value);
     }
 
     void write(const int opcode,
                void* data,
-               const EventResult& response) const override {
-        switch (opcode) {
-            case effOpen: {
+               EventResult& response) const override {
+        switch (dispatch_opcode_traits(opcode).response) {
+            case Vst2PayloadKind::aeffect: {
                 // Update our `AEffect` object one last time for improperly
                 // coded late initialing plugins. Hopefully the host will see
                 // that the object is updated because these plugins don't send
@@ -282,7 +421,7 @@ class DispatchDataConverter : DefaultDataConverter {
                 const auto updated_plugin = std::get<AEffect>(response.payload);
                 update_aeffect(plugin, updated_plugin);
             } break;
-            case effEditGetRect: {
+            case Vst2PayloadKind::vst_rect: {
                 // Either the plugin will have returned (a pointer to) their
                 // editor dimensions, or they will not have written anything.
                 if (std::holds_alternative<std::nullptr_t>(response.payload)) {
@@ -294,18 +433,24 @@ class DispatchDataConverter : DefaultDataConverter {
 
                 *static_cast<VstRect**>(data) = &rect;
             } break;
-            case effGetChunk: {
+            case Vst2PayloadKind::chunk: {
                 // Write the chunk data to some publically accessible place in
                 // `PluginBridge` and write a pointer to that struct to the data
-                // pointer
-                const auto buffer =
-                    std::get<std::vector<uint8_t>>(response.payload);
-                chunk.assign(buffer.begin(), buffer.end());
+                // pointer. Large chunks arrive through a memfd, in which case
+                // we read them into that same buffer directly.
+                if (auto* memfd = std::get_if<ChunkMemfd>(&response.payload)) {
+                    memfd->read_into(chunk);
+                } else {
+                    // We can move the chunk data out of the deserialized
+                    // response instead of copying a potentially 50 MB buffer
+                    // two more times
+                    chunk = std::move(
+                        std::get<std::vector<uint8_t>>(response.payload));
+                }
 
                 *static_cast<uint8_t**>(data) = chunk.data();
             } break;
-            case effGetInputProperties:
-            case effGetOutputProperties: {
+            case Vst2PayloadKind::io_properties: {
                 // These opcodes pass the plugin some empty struct through the
                 // data parameter that the plugin then fills with flags and
                 // other data to describe an input or output channel.
@@ -314,25 +459,27 @@ class DispatchDataConverter : DefaultDataConverter {
 
                 *static_cast<VstIOProperties*>(data) = properties;
             } break;
-            case effGetParameterProperties: {
+            case Vst2PayloadKind::parameter_properties: {
                 // Same as the above
                 const auto properties =
                     std::get<VstParameterProperties>(response.payload);
 
                 *static_cast<VstParameterProperties*>(data) = properties;
             } break;
-            case effGetMidiKeyName: {
+            case Vst2PayloadKind::midi_key_name: {
                 // Ditto
                 const auto properties =
                     std::get<VstMidiKeyName>(response.payload);
 
                 *static_cast<VstMidiKeyName*>(data) = properties;
             } break;
-            case effGetSpeakerArrangement: {
+            case Vst2PayloadKind::speaker_arrangement: {
                 // The plugin will have updated the objects passed by the host
                 // with its preferred output speaker configuration if it
                 // supports this. The same thing happens for the input speaker
-                // configuration in `write_value()`.
+                // configuration in `write_value()`. Note that `write_value()`
+                // still reads from this same payload afterwards, so we can't
+                // move it out here.
                 auto speaker_arrangement =
                     std::get<DynamicSpeakerArrangement>(response.payload);
 
@@ -360,28 +507,28 @@ class DispatchDataConverter : DefaultDataConverter {
 
     void write_value(const int opcode,
                      intptr_t value,
-                     const EventResult& response) const override {
-        switch (opcode) {
-            case effGetSpeakerArrangement: {
-                // Same as the above, but now for the input speaker
-                // configuration object under the `value` pointer
-                auto speaker_arrangement =
-                    std::get<DynamicSpeakerArrangement>(response.payload);
-
-                VstSpeakerArrangement* output =
-                    static_cast<VstSpeakerArrangement*>(
-                        reinterpret_cast<void*>(value));
-                std::vector<uint8_t> reconstructed_object =
-                    speaker_arrangement.as_raw_data();
-                std::copy(reconstructed_object.begin(),
-                          reconstructed_object.end(),
-                          reinterpret_cast<uint8_t*>(output));
-            } break;
-            default:
-                return DefaultDataConverter::write_value(opcode, value,
-                                                         response);
-                break;
+                     EventResult& response) const override {
+        const Vst2OpcodeTraits traits = dispatch_opcode_traits(opcode);
+        if (traits.value_payload &&
+            traits.response == Vst2PayloadKind::speaker_arrangement) {
+            // Same as the above, but now for the input speaker configuration
+            // object under the `value` pointer. This only applies to
+            // `effGetSpeakerArrangement`, as `effSetSpeakerArrangement`
+            // doesn't write anything back.
+            auto speaker_arrangement = std::move(
+                std::get<DynamicSpeakerArrangement>(response.payload));
+
+            VstSpeakerArrangement* output = static_cast<VstSpeakerArrangement*>(
+                reinterpret_cast<void*>(value));
+            std::vector<uint8_t> reconstructed_object =
+                speaker_arrangement.as_raw_data();
+            std::copy(reconstructed_object.begin(), reconstructed_object.end(),
+                      reinterpret_cast<uint8_t*>(output));
+
+            return;
         }
+
+        return DefaultDataConverter::write_value(opcode, value, response);
     }
 
    private:
@@ -413,6 +560,17 @@ intptr_t PluginBridge::dispatch(AEffect* /*plugin*/,
         return 0;
     }
 
+    // With pipelined processing enabled the last submitted audio block may
+    // still be in flight. It has to be collected before suspending or
+    // shutting down so its results don't bleed into the next processing
+    // cycle after a resume, and so the Wine host isn't left writing into a
+    // buffer that's being torn down.
+    if (BOOST_UNLIKELY(process_block_in_flight) &&
+        (opcode == effMainsChanged || opcode == effStopProcess ||
+         opcode == effClose)) {
+        drain_process_pipeline();
+    }
+
     DispatchDataConverter converter(chunk_data, plugin, editor_rectangle);
 
     switch (opcode) {
@@ -433,12 +591,20 @@ intptr_t PluginBridge::dispatch(AEffect* /*plugin*/,
                 logger.log("The plugin crashed during shutdown, ignoring");
             }
 
+            // When profiling is enabled this is the last chance to report the
+            // accumulated latency histograms for this process
+            if (EventProfiler* profiler = EventProfiler::instance()) {
+                profiler->dump(logger);
+            }
+
             vst_host->terminate();
 
-            // The `stop()` method will cause the IO context to just drop all of
-            // its work immediately and not throw any exceptions that would have
-            // been caused by pipes and sockets being closed.
-            io_context.stop();
+            // The IO context is shared with the other plugin instances in
+            // this process, so instead of just stopping it we'll close this
+            // instance's STDIO pipes and wait for their read handlers to
+            // finish. Otherwise a handler could still dereference the host
+            // process object after the `delete` below.
+            vst_host->close_stdio();
 
             delete this;
 
@@ -483,45 +649,272 @@ intptr_t PluginBridge::dispatch(AEffect* /*plugin*/,
 
 template <typename T, bool replacing>
 void PluginBridge::do_process(T** inputs, T** outputs, int sample_frames) {
-    // The inputs and outputs arrays should be `[num_inputs][sample_frames]` and
-    // `[num_outputs][sample_frames]` floats large respectfully.
-    std::vector<std::vector<T>> input_buffers(plugin.numInputs,
-                                              std::vector<T>(sample_frames));
-    for (int channel = 0; channel < plugin.numInputs; channel++) {
-        std::copy(inputs[channel], inputs[channel] + sample_frames,
-                  input_buffers[channel].begin());
-    }
-
-    const AudioBuffers request{input_buffers, sample_frames};
-    sockets.host_vst_process_replacing.send(request, process_buffer);
-
-    // Write the results back to the `outputs` arrays
-    const auto response =
-        sockets.host_vst_process_replacing.receive_single<AudioBuffers>(
-            process_buffer);
-    const auto& response_buffers =
-        std::get<std::vector<std::vector<T>>>(response.buffers);
-
-    assert(response_buffers.size() == static_cast<size_t>(plugin.numOutputs));
-    for (int channel = 0; channel < plugin.numOutputs; channel++) {
+    // When profiling is enabled we'll time the entire processing cycle,
+    // including the buffer copies on this side, see `EventProfiler`
+    EventProfiler* const profiler = EventProfiler::instance();
+    std::chrono::steady_clock::time_point processing_start{};
+    if (profiler) {
+        processing_start = std::chrono::steady_clock::now();
+    }
+
+    // Plugins commonly call `audioMasterGetTime()` at least once per
+    // processing cycle, and the time info only changes in between blocks.
+    // We'll take a single snapshot here and send it along with the audio so
+    // the Wine VST host can serve those calls locally instead of doing a
+    // socket round trip for every one of them.
+    const VstTimeInfo* time_info =
+        reinterpret_cast<const VstTimeInfo*>(host_callback_function(
+            &plugin, audioMasterGetTime, 0, time_info_all_fields, nullptr,
+            0.0));
+
+    // Write a block's processed audio to `outputs`, either replacing or
+    // accumulating depending on which processing function got called. The
+    // block's channel and frame counts are clamped against what the host
+    // asked for, since they may come off the wire (where they can't be
+    // trusted) or from a block submitted with different settings in the
+    // pipelined mode described below. Excess data gets dropped and any
+    // missing frames or channels are padded with silence, which only causes
+    // a glitch at the transition itself.
+    const auto copy_outputs = [&](const T* output_base, int block_frames,
+                                  int block_channels) {
+        const int valid_frames = std::min(block_frames, sample_frames);
+        const int valid_channels = std::min(block_channels, plugin.numOutputs);
+        for (int channel = 0; channel < valid_channels; channel++) {
+            const T* output_channel =
+                output_base + (static_cast<size_t>(channel) * block_frames);
+            if constexpr (replacing) {
+                std::copy(output_channel, output_channel + valid_frames,
+                          outputs[channel]);
+                std::fill(outputs[channel] + valid_frames,
+                          outputs[channel] + sample_frames, T(0));
+            } else {
+                std::transform(output_channel, output_channel + valid_frames,
+                               outputs[channel], outputs[channel],
+                               [](const T& new_value, T& current_value) -> T {
+                                   return new_value + current_value;
+                               });
+            }
+        }
+
+        if constexpr (replacing) {
+            for (int channel = valid_channels; channel < plugin.numOutputs;
+                 channel++) {
+                std::fill(outputs[channel], outputs[channel] + sample_frames,
+                          T(0));
+            }
+        }
+    };
+
+    // In the pipelined mode there's no previous block to return on the very
+    // first call and after a suspend, in which case we'll output silence
+    const auto output_silence = [&]() {
         if constexpr (replacing) {
-            std::copy(response_buffers[channel].begin(),
-                      response_buffers[channel].end(), outputs[channel]);
+            for (int channel = 0; channel < plugin.numOutputs; channel++) {
+                std::fill(outputs[channel], outputs[channel] + sample_frames,
+                          T(0));
+            }
+        }
+    };
+
+    if (BOOST_LIKELY(audio_shm.has_value())) {
+        // The fast path: write the input buffers directly into the shared
+        // memory mapping, ring the doorbell, and wait for the Wine VST host to
+        // process the audio in place. This avoids serializing and copying the
+        // audio buffers twice for every processing cycle.
+        const size_t input_size =
+            static_cast<size_t>(plugin.numInputs) * sample_frames * sizeof(T);
+        const size_t output_size =
+            static_cast<size_t>(plugin.numOutputs) * sample_frames * sizeof(T);
+
+        // Write the inputs and the block's metadata into the mapping, ring
+        // the doorbell, and return the response counter value that identifies
+        // the completion of this block
+        const auto submit_block = [&]() {
+            audio_shm->resize_to_fit(input_size + output_size);
+
+            T* input_base = reinterpret_cast<T*>(audio_shm->data());
+            for (int channel = 0; channel < plugin.numInputs; channel++) {
+                std::copy(inputs[channel], inputs[channel] + sample_frames,
+                          input_base + (channel * sample_frames));
+            }
+
+            AudioShmBuffer::Header* header = audio_shm->header();
+            header->double_precision = std::is_same_v<T, double>;
+            header->num_input_channels = plugin.numInputs;
+            header->num_output_channels = plugin.numOutputs;
+            header->sample_frames = sample_frames;
+            if (time_info) {
+                header->time_info = *time_info;
+                header->time_info_valid = 1;
+            } else {
+                header->time_info_valid = 0;
+            }
+
+            // Since at most one block is ever in flight we can simply
+            // remember the response counter's current value to detect the
+            // Wine VST host's response
+            const uint32_t last_response =
+                header->response_counter.load(std::memory_order_acquire);
+            audio_shm->notify_request();
+
+            return last_response;
+        };
+
+        // We use a timeout here so we can detect the Wine process dying while
+        // we're waiting on it, similar to how the socket based transport would
+        // throw when its socket gets closed
+        const auto wait_for_wine_host = [&](uint32_t last_response) {
+            using namespace std::literals::chrono_literals;
+            while (!audio_shm->wait_for_response(last_response, 1000ms)) {
+                if (audio_shm->header()->shutdown.load(
+                        std::memory_order_acquire) != 0 ||
+                    !vst_host->running()) {
+                    throw std::runtime_error(
+                        "The Wine host process has exited unexpectedly during "
+                        "audio processing");
+                }
+            }
+        };
+
+        if (BOOST_LIKELY(!config.pipelined_processing)) {
+            const uint32_t last_response = submit_block();
+            wait_for_wine_host(last_response);
+
+            copy_outputs(
+                reinterpret_cast<const T*>(audio_shm->data() + input_size),
+                sample_frames, plugin.numOutputs);
+        } else {
+            // The pipelined mode processes one block ahead: this call returns
+            // the previous call's results and only submits the current block,
+            // so the Wine process crunches it while the host's worker thread
+            // already moves on to the next plugin. The previous block's
+            // results have to be collected before `submit_block()` overwrites
+            // the mapping. See `Configuration::pipelined_processing` for the
+            // trade-offs.
+            bool collected_previous_block = false;
+            if (process_block_in_flight) {
+                wait_for_wine_host(pipeline_expected_response);
+                process_block_in_flight = false;
+
+                if (pipeline_double_precision == std::is_same_v<T, double>) {
+                    copy_outputs(reinterpret_cast<const T*>(
+                                     audio_shm->data() +
+                                     pipeline_output_offset),
+                                 pipeline_sample_frames,
+                                 pipeline_output_channels);
+                    collected_previous_block = true;
+                }
+            }
+            if (!collected_previous_block) {
+                output_silence();
+            }
+
+            pipeline_expected_response = submit_block();
+            process_block_in_flight = true;
+            pipeline_sample_frames = sample_frames;
+            pipeline_output_channels = plugin.numOutputs;
+            pipeline_output_offset = input_size;
+            pipeline_double_precision = std::is_same_v<T, double>;
+        }
+    } else {
+        // Copy the inputs into the persistent request object's flat buffer.
+        // The buffer's backing allocation is reused across processing cycles,
+        // so aside from the very first cycles (or when the buffer size
+        // changes) this does not allocate on the real-time thread.
+        process_request.resize_to<T>(plugin.numInputs, sample_frames);
+        for (int channel = 0; channel < plugin.numInputs; channel++) {
+            std::copy(inputs[channel], inputs[channel] + sample_frames,
+                      process_request.channel<T>(channel));
+        }
+
+        if (time_info) {
+            process_request.time_info = *time_info;
+        } else {
+            process_request.time_info.reset();
+        }
+
+        if (BOOST_LIKELY(!config.pipelined_processing)) {
+            sockets.host_vst_process_replacing.send(process_request,
+                                                    process_buffer);
+
+            if constexpr (replacing) {
+                // Deserialize the response directly into the `outputs`
+                // arrays, without the response buffers ever existing as a
+                // separate allocation. The deserializer refuses to write
+                // anything when the response doesn't exactly match the
+                // channel and frame counts the host asked for, since those
+                // sizes come off the wire and can't be trusted.
+                AudioBuffersOutput<T> response{outputs, plugin.numOutputs,
+                                               sample_frames};
+                sockets.host_vst_process_replacing.receive_into(
+                    response, process_buffer);
+                if (BOOST_UNLIKELY(!response.valid)) {
+                    throw std::runtime_error(
+                        "Received a mismatched audio response from the Wine "
+                        "VST host");
+                }
+            } else {
+                // The old `process()` function expects the plugin to add its
+                // output to the accumulated values in `outputs`, so we can't
+                // deserialize in place here. Since no host is ever going to
+                // call this anyways we won't even bother with a separate
+                // implementation and we'll just add `processReplacing()`
+                // results to `outputs`.
+                auto response = sockets.host_vst_process_replacing
+                                    .receive_single<AudioBuffers>(
+                                        process_buffer);
+
+                // The response's channel and frame counts came off the wire,
+                // so aside from the clamping in `copy_outputs()` they also
+                // have to be checked against the flat buffer's actual size
+                // before reading channel rows out of it
+                if (BOOST_UNLIKELY(
+                        !std::holds_alternative<std::vector<T>>(
+                            response.buffers) ||
+                        std::get<std::vector<T>>(response.buffers).size() <
+                            static_cast<size_t>(response.num_channels) *
+                                response.sample_frames)) {
+                    throw std::runtime_error(
+                        "Received a mismatched audio response from the Wine "
+                        "VST host");
+                }
+
+                copy_outputs(response.channel<T>(0), response.sample_frames,
+                             response.num_channels);
+            }
         } else {
-            // The old `process()` function expects the plugin to add its output
-            // to the accumulated values in `outputs`. Since no host is ever
-            // going to call this anyways we won't even bother with a separate
-            // implementation and we'll just add `processReplacing()` results to
-            // `outputs`.
-            // We could use `std::execution::unseq` here but that would require
-            // linking to TBB and since this probably won't ever be used anyways
-            // that's a bit of a waste.
-            std::transform(response_buffers[channel].begin(),
-                           response_buffers[channel].end(), outputs[channel],
-                           outputs[channel],
-                           [](const T& new_value, T& current_value) -> T {
-                               return new_value + current_value;
-                           });
+            // The same one-block-ahead pipeline as on the shared memory path
+            // above. Unlike there, the previous block's results live in their
+            // own persistent response object, so we can submit the new block
+            // first and let the Wine process start crunching before we copy
+            // the previous results over.
+            const bool have_previous_block = process_block_in_flight;
+            if (have_previous_block) {
+                sockets.host_vst_process_replacing.receive_into(
+                    pipeline_response, process_buffer);
+                process_block_in_flight = false;
+            }
+
+            sockets.host_vst_process_replacing.send(process_request,
+                                                    process_buffer);
+            process_block_in_flight = true;
+
+            // The same wire size checks as on the synchronous path above.
+            // Since this block's results are stale by definition, a
+            // mismatched response simply gets dropped in favour of silence
+            // instead of failing the whole call.
+            if (have_previous_block &&
+                std::holds_alternative<std::vector<T>>(
+                    pipeline_response.buffers) &&
+                std::get<std::vector<T>>(pipeline_response.buffers).size() >=
+                    static_cast<size_t>(pipeline_response.num_channels) *
+                        pipeline_response.sample_frames) {
+                copy_outputs(pipeline_response.channel<T>(0),
+                             pipeline_response.sample_frames,
+                             pipeline_response.num_channels);
+            } else {
+                output_silence();
+            }
         }
     }
 
@@ -530,14 +923,48 @@ void PluginBridge::do_process(T** inputs, T** outputs, int sample_frames) {
     // `processReplacing()` function or else the host will ignore them. To
     // prevent these events from getting delayed by a sample we'll process them
     // after the plugin is done processing audio rather than during the time
-    // we're still waiting on the plugin.
-    std::lock_guard lock(incoming_midi_events_mutex);
-    for (DynamicVstEvents& events : incoming_midi_events) {
+    // we're still waiting on the plugin. The `VstEvents` structs were already
+    // built when the batches were enqueued, so this doesn't lock or allocate.
+    while (DynamicVstEvents* events = incoming_midi_events.peek()) {
         host_callback_function(&plugin, audioMasterProcessEvents, 0, 0,
-                               &events.as_c_events(), 0.0);
+                               &events->as_c_events(), 0.0);
+
+        incoming_midi_events.pop();
+    }
+
+    if (profiler) {
+        profiler->record_audio_processing(std::chrono::steady_clock::now() -
+                                          processing_start);
+    }
+}
+
+void PluginBridge::drain_process_pipeline() {
+    if (!process_block_in_flight) {
+        return;
     }
+    process_block_in_flight = false;
 
-    incoming_midi_events.clear();
+    if (audio_shm) {
+        using namespace std::literals::chrono_literals;
+        while (!audio_shm->wait_for_response(pipeline_expected_response,
+                                             1000ms)) {
+            if (audio_shm->header()->shutdown.load(
+                    std::memory_order_acquire) != 0 ||
+                !vst_host->running()) {
+                // The Wine process is gone, so there's nothing left to wait
+                // for
+                return;
+            }
+        }
+    } else {
+        try {
+            sockets.host_vst_process_replacing.receive_into(pipeline_response,
+                                                            process_buffer);
+        } catch (const boost::system::system_error&) {
+            // Same as the above, the sockets got closed because the Wine
+            // process exited before responding
+        }
+    }
 }
 
 void PluginBridge::process(AEffect* /*plugin*/,
@@ -564,42 +991,146 @@ void PluginBridge::process_double_replacing(AEffect* /*plugin*/,
 float PluginBridge::get_parameter(AEffect* /*plugin*/, int index) {
     logger.log_get_parameter(index);
 
-    const Parameter request{index, std::nullopt};
-    ParameterResult response;
+    float value;
+
+    // When the parameter cache is enabled we can answer from the cache
+    // without touching the socket at all, refreshing all values in a single
+    // bulk round trip every once in a while. Out of range indices (which
+    // could happen when the plugin resizes its parameter list after an
+    // `audioMasterIOChanged()`) take the regular path below.
+    if (index >= 0 && static_cast<size_t>(index) < parameter_cache.size()) {
+        refresh_parameter_cache();
+
+        value = parameter_cache[index].load(std::memory_order_relaxed);
+        logger.log_get_parameter_response(value);
+
+        return value;
+    }
 
     // Prevent race conditions from `getParameter()` and `setParameter()` being
     // called at the same time since  they share the same socket
     {
         std::lock_guard lock(parameters_mutex);
-        sockets.host_vst_parameters.send(request);
 
-        response =
-            sockets.host_vst_parameters.receive_single<ParameterResult>();
+        // Any `setParameter()` calls that were queued up while another round
+        // trip was in flight get flushed together with our query, with the
+        // query as the batch's last element so the plugin has already applied
+        // those changes when it reads back the value
+        {
+            std::lock_guard pending_lock(pending_parameters_mutex);
+            parameter_batch.parameters.clear();
+            std::swap(parameter_batch.parameters, pending_parameter_sets);
+        }
+        parameter_batch.parameters.push_back(Parameter{index, std::nullopt});
+
+        const ParameterBatchResult response = send_parameter_batch();
+
+        assert(response.results.size() == parameter_batch.parameters.size());
+        value = *response.results.back().value;
     }
 
-    logger.log_get_parameter_response(*response.value);
+    logger.log_get_parameter_response(value);
 
-    return *response.value;
+    return value;
 }
 
 void PluginBridge::set_parameter(AEffect* /*plugin*/, int index, float value) {
     logger.log_set_parameter(index, value);
 
-    const Parameter request{index, value};
-    ParameterResult response;
+    // Keep the parameter cache coherent with values the host sets itself, so
+    // reading the value back doesn't have to wait for the next bulk refresh
+    if (index >= 0 && static_cast<size_t>(index) < parameter_cache.size()) {
+        parameter_cache[index].store(value, std::memory_order_relaxed);
+    }
 
     {
-        std::lock_guard lock(parameters_mutex);
-        sockets.host_vst_parameters.send(request);
+        std::lock_guard pending_lock(pending_parameters_mutex);
+        pending_parameter_sets.push_back(Parameter{index, value});
+    }
 
-        response =
-            sockets.host_vst_parameters.receive_single<ParameterResult>();
+    // If another thread is performing a parameter round trip right now, then
+    // that thread (or whichever of the waiting threads acquires the mutex
+    // first) will flush the value we just queued together with all other
+    // pending changes in a single message. In that case the flush below will
+    // simply be a no-op.
+    {
+        std::lock_guard lock(parameters_mutex);
+        flush_pending_parameters();
     }
 
     logger.log_set_parameter_response();
+}
+
+void PluginBridge::refresh_parameter_cache() {
+    std::lock_guard lock(parameters_mutex);
+
+    const auto now = std::chrono::steady_clock::now();
+    if (now - last_parameter_cache_refresh < parameter_cache_refresh_interval) {
+        return;
+    }
+    last_parameter_cache_refresh = now;
+
+    // Any pending `setParameter()` calls get flushed in the same batch, in
+    // front of our queries, so the values we read back already include them
+    {
+        std::lock_guard pending_lock(pending_parameters_mutex);
+        parameter_batch.parameters.clear();
+        std::swap(parameter_batch.parameters, pending_parameter_sets);
+    }
+    const size_t num_pending_sets = parameter_batch.parameters.size();
+    for (size_t param = 0; param < parameter_cache.size(); param++) {
+        parameter_batch.parameters.push_back(
+            Parameter{static_cast<int>(param), std::nullopt});
+    }
 
-    // This should not contain any values and just serve as an acknowledgement
-    assert(!response.value);
+    const ParameterBatchResult response = send_parameter_batch();
+
+    assert(response.results.size() == parameter_batch.parameters.size());
+    for (size_t param = 0; param < parameter_cache.size(); param++) {
+        parameter_cache[param].store(
+            *response.results[num_pending_sets + param].value,
+            std::memory_order_relaxed);
+    }
+}
+
+void PluginBridge::flush_pending_parameters() {
+    {
+        std::lock_guard pending_lock(pending_parameters_mutex);
+        if (pending_parameter_sets.empty()) {
+            return;
+        }
+
+        // This swap keeps both vectors' heap allocations alive, so after the
+        // first few calls flushing won't allocate at all
+        parameter_batch.parameters.clear();
+        std::swap(parameter_batch.parameters, pending_parameter_sets);
+    }
+
+    const ParameterBatchResult response = send_parameter_batch();
+
+    // The results should just serve as acknowledgements since `setParameter()`
+    // doesn't return anything
+    assert(response.results.size() == parameter_batch.parameters.size());
+}
+
+ParameterBatchResult PluginBridge::send_parameter_batch() {
+    EventProfiler* const profiler = EventProfiler::instance();
+    std::chrono::steady_clock::time_point roundtrip_start{};
+    if (profiler) {
+        roundtrip_start = std::chrono::steady_clock::now();
+    }
+
+    sockets.host_vst_parameters.send(parameter_batch, parameters_buffer);
+    ParameterBatchResult response =
+        sockets.host_vst_parameters.receive_single<ParameterBatchResult>(
+            parameters_buffer);
+
+    if (profiler) {
+        profiler->record_parameters(std::chrono::steady_clock::now() -
+                                    roundtrip_start);
+    }
+
+    return response;
 }
 
 void PluginBridge::log_init_message() {
@@ -653,9 +1184,21 @@ void PluginBridge::log_init_message() {
 
     init_msg << "other options: ";
     std::vector<std::string> other_options;
+    if (config.cache_parameters) {
+        other_options.push_back("parameters: cached");
+    }
     if (config.editor_double_embed) {
         other_options.push_back("editor: double embed");
     }
+    if (config.low_latency_spin) {
+        other_options.push_back("audio: low latency spin");
+    }
+    if (config.prewarm_hosts) {
+        other_options.push_back("hosts: pre-warmed");
+    }
+    if (config.single_endpoint) {
+        other_options.push_back("sockets: single endpoint");
+    }
     if (!other_options.empty()) {
         init_msg << join_quoted_strings(other_options) << std::endl;
     } else {
@@ -20,13 +20,20 @@
 
 #include <boost/asio/io_context.hpp>
 #include <boost/asio/local/stream_protocol.hpp>
+#include <boost/asio/posix/stream_descriptor.hpp>
+#include <boost/asio/steady_timer.hpp>
+#include <atomic>
+#include <chrono>
 #include <mutex>
 #include <thread>
 
+#include "../common/audio-shm.h"
 #include "../common/communication.h"
 #include "../common/configuration.h"
 #include "../common/logging.h"
+#include "../common/midi-queue.h"
 #include "host-process.h"
+#include "shared-io-context.h"
 
 /**
  * This handles the communication between the Linux native VST plugin and the
@@ -114,6 +121,16 @@ class PluginBridge {
     template <typename T, bool replacing>
     void do_process(T** inputs, T** outputs, int sample_frames);
 
+    /**
+     * Wait for a block submitted through the pipelined processing mode to
+     * finish and discard its results. Called before suspending or closing the
+     * plugin so no block stays in flight across state changes, and a no-op
+     * when nothing is in flight.
+     *
+     * @see Configuration::pipelined_processing
+     */
+    void drain_process_pipeline();
+
     /**
      * The configuration for this instance of yabridge. Set based on the values
      * from a `yabridge.toml`, if it exists.
@@ -140,7 +157,14 @@ class PluginBridge {
      */
     void log_init_message();
 
-    boost::asio::io_context io_context;
+    /**
+     * The IO context and worker thread pool shared by every plugin instance
+     * within this process. Used for relaying the Wine process's STDOUT and
+     * STDERR output and for the startup watchdog timer.
+     *
+     * @see SharedIoContext::instance
+     */
+    std::shared_ptr<SharedIoContext> io_context;
     Sockets<std::jthread> sockets;
 
     /**
@@ -149,13 +173,80 @@ class PluginBridge {
     std::jthread host_callback_handler;
 
     /**
-     * A mutex to prevent multiple simultaneous calls to `getParameter()` and
-     * `setParameter()`. This likely won't happen, but better safe than sorry.
-     * For `dispatch()` and `audioMaster()` there's some more complex logic for
-     * this in `EventHandler`.
+     * Flush all queued `setParameter()` calls from `pending_parameter_sets` to
+     * the Wine VST host in a single `ParameterBatch` message. Does nothing
+     * when there are no pending calls. May only be called while holding
+     * `parameters_mutex`.
+     */
+    void flush_pending_parameters();
+
+    /**
+     * Send `parameter_batch` over the `host_vst_parameters` socket and wait
+     * for the results. When profiling is enabled the round trip gets timed
+     * and recorded, see `EventProfiler`. May only be called while holding
+     * `parameters_mutex`.
+     */
+    ParameterBatchResult send_parameter_batch();
+
+    /**
+     * Refresh `parameter_cache` in bulk by querying every parameter in a
+     * single `ParameterBatch` round trip, rate limited to once every
+     * `parameter_cache_refresh_interval`. Does nothing when the cache is not
+     * in use. This locks `parameters_mutex` itself.
+     *
+     * @see Configuration::cache_parameters
+     */
+    void refresh_parameter_cache();
+
+    /**
+     * A mutex to prevent multiple simultaneous round trips over the
+     * `host_vst_parameters` socket. Hosts ramping automation will call
+     * `setParameter()` dozens of times per processing cycle, so any calls that
+     * come in while another thread holds this mutex are queued up in
+     * `pending_parameter_sets` and then flushed in a single batch.
      */
     std::mutex parameters_mutex;
 
+    /**
+     * `setParameter()` calls that still have to be sent to the Wine VST host.
+     * These are coalesced into a single `ParameterBatch` message by whichever
+     * thread next acquires `parameters_mutex`.
+     */
+    std::vector<Parameter> pending_parameter_sets;
+    /**
+     * Mutex for locking `pending_parameter_sets`, so parameter changes can be
+     * queued while another round trip is still in flight.
+     */
+    std::mutex pending_parameters_mutex;
+
+    /**
+     * When `Configuration::cache_parameters` is enabled this contains one
+     * atomic value for every one of the plugin's parameters, and
+     * `get_parameter()` will be answered from here instead of doing a round
+     * trip per call. The cache is updated on every `setParameter()`
+     * passthrough and on `audioMasterAutomate` callbacks, and refreshed in
+     * bulk by `refresh_parameter_cache()`. Left empty when the option is
+     * disabled or when the plugin does not report any parameters.
+     */
+    std::vector<std::atomic<float>> parameter_cache;
+    /**
+     * The last time `parameter_cache` was refreshed in bulk. May only be used
+     * while holding `parameters_mutex`.
+     */
+    std::chrono::steady_clock::time_point last_parameter_cache_refresh{};
+
+    /**
+     * A persistent batch object so flushing parameters doesn't allocate after
+     * the first few calls. May only be used while holding `parameters_mutex`.
+     */
+    ParameterBatch parameter_batch;
+    /**
+     * A scratch buffer for sending and receiving parameter batches, reused for
+     * the same reason as the above. May only be used while holding
+     * `parameters_mutex`.
+     */
+    std::vector<uint8_t> parameters_buffer;
+
     /**
      * The callback function passed by the host to the VST plugin instance.
      */
@@ -183,13 +274,30 @@ class PluginBridge {
     std::unique_ptr<HostProcess> vst_host;
 
     /**
-     * A thread used during the initialisation process to terminate listening on
+     * Schedule the next check of `host_guard_timer`. The handler checks
+     * whether the Wine process is still running, terminates when it is not,
+     * and otherwise schedules itself again. Only used when we could not set
+     * up `host_guard_pidfd`.
+     */
+    void schedule_host_guard_check();
+
+    /**
+     * A timer used during the initialisation process to terminate listening on
      * the sockets if the Wine process cannot start for whatever reason. This
-     * has to be defined here instead of in the constructor we can't simply
-     * detach the thread as it has to check whether the VST host is still
-     * running.
+     * runs on the shared IO context so it doesn't need a thread of its own,
+     * and it gets disarmed through `host_guard_active` as soon as all sockets
+     * have been connected to.
+     */
+    std::optional<boost::asio::steady_timer> host_guard_timer;
+    /**
+     * A pidfd for the Wine host process, when the kernel supports
+     * `pidfd_open()` and the host's PID is known during startup. Waiting on
+     * this descriptor wakes us up the moment the process exits, so the guard
+     * doesn't have to poll the process's status at all. The polling timer
+     * above remains as the fallback.
      */
-    std::jthread host_guard_handler;
+    std::optional<boost::asio::posix::stream_descriptor> host_guard_pidfd;
+    std::atomic_bool host_guard_active = false;
 
     /**
      * Whether this process runs with realtime priority. We'll set this _after_
@@ -199,17 +307,78 @@ class PluginBridge {
     bool has_realtime_priority;
 
     /**
-     * Runs the Boost.Asio `io_context` thread for logging the Wine process
-     * STDOUT and STDERR messages.
+     * The shared memory buffer used to pass audio between this plugin and the
+     * Wine VST host without any serialization. This will be empty when either
+     * side could not map the buffer, in which case the audio buffers are sent
+     * over the `host_vst_process_replacing` socket as usual.
+     *
+     * @see AudioShmBuffer
      */
-    std::jthread wine_io_handler;
+    std::optional<AudioShmBuffer> audio_shm;
 
     /**
      * A scratch buffer for sending and receiving data during `process`,
-     * `processReplacing` and `processDoubleReplacing` calls.
+     * `processReplacing` and `processDoubleReplacing` calls. Only used when the
+     * shared memory audio buffers are not active.
      */
     std::vector<uint8_t> process_buffer;
 
+    /**
+     * A persistent request object for the socket based audio processing
+     * fallback. Its flat audio buffer is reused across processing cycles and
+     * only ever grows, so we don't perform any per-channel heap allocations on
+     * the real-time thread.
+     */
+    AudioBuffers process_request;
+
+    // The following fields track the block that's currently in flight when
+    // the pipelined processing mode is enabled, see
+    // `Configuration::pipelined_processing`. They are only ever touched from
+    // the host's audio thread, except for `drain_process_pipeline()` which
+    // hosts only call concurrently with processing if they're already broken.
+
+    /**
+     * Whether a submitted block is currently being processed by the Wine VST
+     * host. When this is set, the next `do_process()` call (or
+     * `drain_process_pipeline()`) has to collect the results first.
+     */
+    bool process_block_in_flight = false;
+    /**
+     * The value of the shared memory response counter before the in flight
+     * block was submitted, used to detect its completion.
+     *
+     * @see AudioShmBuffer::wait_for_response
+     */
+    uint32_t pipeline_expected_response = 0;
+    /**
+     * The number of frames in the in flight block. When the host changes its
+     * block size between calls the stale results get padded with silence,
+     * which can only cause a glitch at the transition.
+     */
+    int pipeline_sample_frames = 0;
+    /**
+     * The number of output channels in the in flight block, in case the
+     * plugin's IO configuration changes while the block is being processed.
+     */
+    int pipeline_output_channels = 0;
+    /**
+     * The offset of the output channels within the shared memory buffer for
+     * the in flight block, i.e. the size of its input area in bytes.
+     */
+    size_t pipeline_output_offset = 0;
+    /**
+     * Whether the in flight block was submitted through
+     * `processDoubleReplacing()`. No host switches sample types between
+     * blocks, but if one does the stale results get dropped instead of being
+     * reinterpreted as the wrong type.
+     */
+    bool pipeline_double_precision = false;
+    /**
+     * A persistent response object for the in flight block when using the
+     * socket based fallback, reused for the same reason as `process_request`.
+     */
+    AudioBuffers pipeline_response;
+
     /**
      * The VST host can query a plugin for arbitrary binary data such as
      * presets. It will expect the plugin to write back a pointer that points to
@@ -230,12 +399,9 @@ class PluginBridge {
      * then the host will just discard them. Because we're receiving our host
      * callbacks on a separate thread, we have to temporarily store any events
      * we receive so we can send them to the host at the end of
-     * `process_replacing()`.
-     */
-    std::vector<DynamicVstEvents> incoming_midi_events;
-    /**
-     * Mutex for locking the above event queue, since recieving and processing
-     * now happens in two different threads.
+     * `process_replacing()`. Since receiving and processing happen on two
+     * different threads this is a lock-free queue, so a plugin spraying
+     * events can never block the audio thread.
      */
-    std::mutex incoming_midi_events_mutex;
+    MidiEventQueue incoming_midi_events;
 };
@@ -0,0 +1,53 @@
+// yabridge: a Wine VST bridge
+// Copyright (C) 2020  Robbert van der Helm
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#include "shared-io-context.h"
+
+#include <algorithm>
+#include <mutex>
+
+SharedIoContext::SharedIoContext()
+    : context(), work_guard(boost::asio::make_work_guard(context)) {
+    // The context only handles pipe output and the occasional timer, so a
+    // couple of threads go a long way even on large projects
+    const unsigned int num_workers =
+        std::clamp(std::thread::hardware_concurrency() / 4, 2u, 8u);
+    for (unsigned int i = 0; i < num_workers; i++) {
+        workers.emplace_back([&]() { context.run(); });
+    }
+}
+
+SharedIoContext::~SharedIoContext() {
+    work_guard.reset();
+    context.stop();
+
+    // The std::jthread joins are implicit
+}
+
+std::shared_ptr<SharedIoContext> SharedIoContext::instance() {
+    static std::mutex instance_mutex{};
+    static std::weak_ptr<SharedIoContext> instance{};
+
+    std::lock_guard lock(instance_mutex);
+
+    std::shared_ptr<SharedIoContext> shared = instance.lock();
+    if (!shared) {
+        shared = std::make_shared<SharedIoContext>();
+        instance = shared;
+    }
+
+    return shared;
+}
@@ -0,0 +1,84 @@
+// yabridge: a Wine VST bridge
+// Copyright (C) 2020  Robbert van der Helm
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include <boost/asio/executor_work_guard.hpp>
+#include <boost/asio/io_context.hpp>
+
+/**
+ * A process wide Boost.Asio IO context with a small pool of worker threads,
+ * shared by every `PluginBridge` instance loaded into the same host process.
+ * This is used for relaying the Wine process's STDOUT and STDERR output and
+ * for the startup watchdog timers. Every instance used to run its own
+ * `io_context` on a dedicated thread, which adds up quickly when a project
+ * contains a few hundred plugin instances even though those threads are idle
+ * almost all of the time. With this class the number of IO threads scales
+ * with the number of cores instead.
+ *
+ * Instances hold on to this through a `shared_ptr` obtained from
+ * `SharedIoContext::instance()`. When the last instance lets go of its
+ * reference the worker threads get stopped and joined again. That last part
+ * is important, because the host may unload `libyabridge.so` after the last
+ * plugin instance has been freed and any threads still running code from this
+ * library at that point would crash the host.
+ */
+class SharedIoContext {
+   public:
+    /**
+     * Create the IO context and start the worker threads. Use
+     * `SharedIoContext::instance()` instead of constructing this directly.
+     */
+    SharedIoContext();
+
+    /**
+     * Stop the IO context and join the worker threads.
+     */
+    ~SharedIoContext();
+
+    SharedIoContext(const SharedIoContext&) = delete;
+    SharedIoContext& operator=(const SharedIoContext&) = delete;
+
+    /**
+     * Retrieve the process wide instance, creating it if no `PluginBridge`
+     * instance is currently holding a reference to it.
+     */
+    static std::shared_ptr<SharedIoContext> instance();
+
+    /**
+     * The actual IO context. Sockets, pipes and timers can be bound to this
+     * directly.
+     */
+    boost::asio::io_context context;
+
+   private:
+    /**
+     * Keeps `context.run()` from returning in between asynchronous
+     * operations.
+     */
+    boost::asio::executor_work_guard<boost::asio::io_context::executor_type>
+        work_guard;
+
+    /**
+     * The threads running `context`. The work handled here is very light, so
+     * this pool stays small regardless of the number of plugin instances.
+     */
+    std::vector<std::jthread> workers;
+};
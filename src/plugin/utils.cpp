@@ -21,8 +21,11 @@
 #include <boost/process/pipe.hpp>
 #include <boost/process/search_path.hpp>
 #include <boost/process/system.hpp>
+#include <ctime>
 #include <fstream>
+#include <mutex>
 #include <sstream>
+#include <unordered_map>
 
 // Generated inside of the build directory
 #include <src/common/config/config.h>
@@ -55,7 +58,157 @@ std::optional<fs::path> find_wineprefix() {
     return dosdevices_dir->parent_path();
 }
 
+/**
+ * Return the directory used for yabridge's persistent caches. This follows
+ * the XDG base directory specification, so it will be
+ * `$XDG_CACHE_HOME/yabridge` with a fallback to `~/.cache/yabridge`.
+ */
+fs::path get_cache_directory() {
+    bp::environment env = boost::this_process::environment();
+
+    fs::path cache_dir;
+    if (!env["XDG_CACHE_HOME"].empty()) {
+        cache_dir = env["XDG_CACHE_HOME"].to_string();
+    } else {
+        cache_dir = fs::path(env["HOME"].to_string()) / ".cache";
+    }
+
+    return cache_dir / "yabridge";
+}
+
+/**
+ * Return the path to the persistent plugin architecture cache.
+ */
+fs::path get_architecture_cache_path() {
+    return get_cache_directory() / "architectures";
+}
+
+/**
+ * Rewrite a cache file, keeping only the lines for which `keep_line` returns
+ * true and appending `new_line` at the end. The entire file gets rewritten to
+ * a temporary file first so concurrently reading processes never see a half
+ * written cache. The temporary file includes our PID so two processes
+ * updating the cache at the same time can't corrupt it, the last rename
+ * simply wins. Since these are only caches, failures to write are silently
+ * ignored.
+ */
+template <typename F>
+void update_cache_file(const fs::path& cache_path,
+                       F&& keep_line,
+                       const std::string& new_line) {
+    boost::system::error_code err;
+    fs::create_directories(cache_path.parent_path(), err);
+    if (err) {
+        return;
+    }
+
+    std::vector<std::string> lines{};
+    {
+        std::ifstream cache_file(cache_path);
+        for (std::string line; std::getline(cache_file, line);) {
+            if (keep_line(line)) {
+                lines.push_back(line);
+            }
+        }
+    }
+    lines.push_back(new_line);
+
+    const fs::path temp_path =
+        cache_path.string() + "." +
+        std::to_string(boost::this_process::get_id());
+    {
+        std::ofstream temp_file(temp_path, std::ofstream::trunc);
+        for (const std::string& line : lines) {
+            temp_file << line << '\n';
+        }
+        if (!temp_file) {
+            return;
+        }
+    }
+
+    fs::rename(temp_path, cache_path, err);
+}
+
+/**
+ * Look up a plugin's architecture in the persistent architecture cache. Every
+ * line in the cache file has the format `<architecture> <size> <mtime>
+ * <path>`, with the path at the end because it may contain spaces. An entry
+ * only matches when the file's size and last modification time are unchanged,
+ * so replacing a plugin with a different version invalidates its entry.
+ *
+ * @return The cached architecture, or a nullopt if there's no valid entry for
+ *   the plugin. Unreadable cache files are treated as empty ones.
+ */
+std::optional<PluginArchitecture> read_cached_architecture(
+    const fs::path& plugin_path,
+    uintmax_t file_size,
+    std::time_t mtime) {
+    std::ifstream cache_file(get_architecture_cache_path());
+
+    for (std::string line; std::getline(cache_file, line);) {
+        std::istringstream entry(line);
+        std::string architecture;
+        uintmax_t entry_size;
+        std::time_t entry_mtime;
+        std::string entry_path;
+        entry >> architecture >> entry_size >> entry_mtime >> std::ws;
+        std::getline(entry, entry_path);
+
+        if (entry.fail() || entry_path != plugin_path.string()) {
+            continue;
+        }
+        if (entry_size != file_size || entry_mtime != mtime) {
+            // A stale entry will be overwritten when the plugin's
+            // architecture gets cached again
+            return std::nullopt;
+        }
+
+        if (architecture == "x32") {
+            return PluginArchitecture::vst_32;
+        } else if (architecture == "x64") {
+            return PluginArchitecture::vst_64;
+        }
+    }
+
+    return std::nullopt;
+}
+
+/**
+ * Add or update a plugin's entry in the persistent architecture cache,
+ * dropping any previous entry for the same plugin.
+ */
+void write_cached_architecture(const fs::path& plugin_path,
+                               uintmax_t file_size,
+                               std::time_t mtime,
+                               PluginArchitecture architecture) {
+    std::ostringstream entry;
+    entry << (architecture == PluginArchitecture::vst_32 ? "x32" : "x64")
+          << " " << file_size << " " << mtime << " " << plugin_path.string();
+
+    update_cache_file(
+        get_architecture_cache_path(),
+        [&](const std::string& line) {
+            return !line.ends_with(" " + plugin_path.string());
+        },
+        entry.str());
+}
+
 PluginArchitecture find_vst_architecture(fs::path plugin_path) {
+    // Since DAWs will ask us to instantiate hundreds of plugins during a
+    // plugin scan, we cache the result of the PE header parse below in a
+    // small flat file keyed by the plugin's path, size and last modification
+    // time. That turns rescans into a simple lookup.
+    boost::system::error_code err;
+    const uintmax_t file_size = fs::file_size(plugin_path, err);
+    const std::time_t mtime =
+        err ? 0 : fs::last_write_time(plugin_path, err);
+    if (!err) {
+        if (const auto cached_architecture =
+                read_cached_architecture(plugin_path, file_size, mtime)) {
+            return *cached_architecture;
+        }
+    }
+
     std::ifstream file(plugin_path, std::ifstream::binary | std::ifstream::in);
 
     // The linker will place the offset where the PE signature is placed at the
@@ -82,16 +235,26 @@ PluginArchitecture find_vst_architecture(fs::path plugin_path) {
 
     // These constants are specified in
     // https://docs.microsoft.com/en-us/windows/win32/debug/pe-format#machine-types
+    std::optional<PluginArchitecture> architecture;
     switch (machine_type) {
         case 0x014c:  // IMAGE_FILE_MACHINE_I386
-            return PluginArchitecture::vst_32;
+            architecture = PluginArchitecture::vst_32;
             break;
         case 0x8664:  // IMAGE_FILE_MACHINE_AMD64
         case 0x0000:  // IMAGE_FILE_MACHINE_UNKNOWN
-            return PluginArchitecture::vst_64;
+            architecture = PluginArchitecture::vst_64;
             break;
     }
 
+    if (architecture) {
+        if (!err) {
+            write_cached_architecture(plugin_path, file_size, mtime,
+                                      *architecture);
+        }
+
+        return *architecture;
+    }
+
     // When compiled without optimizations, GCC 9.3 will warn that the function
     // does not return if we put this in a `default:` case instead.
     std::ostringstream error_msg;
@@ -194,7 +357,81 @@ fs::path get_this_file_location() {
     return this_file;
 }
 
+/**
+ * Return the path to the persistent Wine version cache.
+ */
+fs::path get_wine_version_cache_path() {
+    return get_cache_directory() / "wine-versions";
+}
+
+/**
+ * Look up the version reported by a Wine binary in the persistent Wine
+ * version cache. Every line in the cache file has the format
+ * `<mtime>\t<path>\t<version>`, with tabs as separators since both the path
+ * and the version string may contain spaces. An entry only matches when the
+ * binary's last modification time is unchanged, so upgrading Wine
+ * invalidates its entry.
+ *
+ * @return The cached version string, or a nullopt if there's no valid entry
+ *   for the binary. Unreadable cache files are treated as empty ones.
+ */
+std::optional<std::string> read_cached_wine_version(const fs::path& wine_path,
+                                                    std::time_t mtime) {
+    std::ifstream cache_file(get_wine_version_cache_path());
+
+    for (std::string line; std::getline(cache_file, line);) {
+        std::istringstream entry(line);
+        std::string entry_mtime;
+        std::string entry_path;
+        std::string version;
+        std::getline(entry, entry_mtime, '\t');
+        std::getline(entry, entry_path, '\t');
+        std::getline(entry, version);
+
+        if (entry_path != wine_path.string()) {
+            continue;
+        }
+        if (entry_mtime != std::to_string(mtime)) {
+            // A stale entry will be overwritten when the version gets cached
+            // again
+            return std::nullopt;
+        }
+
+        return version;
+    }
+
+    return std::nullopt;
+}
+
+/**
+ * Add or update a Wine binary's entry in the persistent Wine version cache,
+ * dropping any previous entry for the same binary.
+ */
+void write_cached_wine_version(const fs::path& wine_path,
+                               std::time_t mtime,
+                               const std::string& version) {
+    update_cache_file(
+        get_wine_version_cache_path(),
+        [&](const std::string& line) {
+            return line.find("\t" + wine_path.string() + "\t") ==
+                   std::string::npos;
+        },
+        std::to_string(mtime) + "\t" + wine_path.string() + "\t" + version);
+}
+
 std::string get_wine_version() {
+    // This function gets called from every `PluginBridge` constructor purely
+    // for the startup log banner, so we'll memoize the result process wide.
+    // Loading a project with 150 plugin instances should not spawn 150 `wine
+    // --version` subprocesses.
+    static std::mutex wine_version_mutex{};
+    static std::optional<std::string> memoized_version{};
+
+    std::lock_guard lock(wine_version_mutex);
+    if (memoized_version) {
+        return *memoized_version;
+    }
+
     // The '*.exe' scripts generated by winegcc allow you to override the binary
     // used to run Wine, so will will respect this as well
     std::string wine_command = "wine";
@@ -204,9 +441,24 @@ std::string get_wine_version() {
         wine_command = env["WINELOADER"].to_string();
     }
 
+    const fs::path wine_path = bp::search_path(wine_command);
+
+    // Across sessions we also keep the version in a persistent cache keyed by
+    // the binary's path and last modification time, so even the first
+    // instance doesn't have to pay for a process launch unless Wine got
+    // updated
+    boost::system::error_code err;
+    const std::time_t mtime = fs::last_write_time(wine_path, err);
+    if (!err) {
+        if (const auto cached_version =
+                read_cached_wine_version(wine_path, mtime)) {
+            memoized_version = *cached_version;
+            return *cached_version;
+        }
+    }
+
     bp::ipstream output;
     try {
-        const fs::path wine_path = bp::search_path(wine_command);
         bp::system(wine_path, "--version", bp::std_out = output);
     } catch (const std::system_error&) {
         return "<NOT FOUND>";
@@ -224,6 +476,11 @@ std::string get_wine_version() {
         version_string = version_string.substr(version_prefix.size());
     }
 
+    if (!err) {
+        write_cached_wine_version(wine_path, mtime, version_string);
+    }
+    memoized_version = version_string;
+
     return version_string;
 }
 
@@ -238,16 +495,78 @@ std::string join_quoted_strings(std::vector<std::string>& strings) {
     return joined_strings.str();
 }
 
+/**
+ * A previously loaded configuration, see `load_config_for()`. Keeping track
+ * of the matched file's last modification time lets us reuse the parsed
+ * configuration for as long as the file doesn't change.
+ */
+struct CachedConfiguration {
+    Configuration config;
+    std::optional<fs::path> config_file;
+    std::time_t mtime;
+};
+
 Configuration load_config_for(const fs::path& yabridge_path) {
+    // Every plugin instantiation goes through this function, so during a
+    // project load the same directories would be walked and the same TOML
+    // files parsed hundreds of times over. The parsed configuration is cached
+    // per .so file rather than per directory because plugins within the same
+    // directory can still match different glob patterns in the same
+    // `yabridge.toml`. The result of the upward directory walk is shared
+    // between all plugins in the same directory, which also means that a
+    // newly created `yabridge.toml` is only picked up by new sessions.
+    static std::mutex config_cache_mutex{};
+    static std::unordered_map<std::string, std::optional<fs::path>>
+        config_file_cache{};
+    static std::unordered_map<std::string, CachedConfiguration> config_cache{};
+
+    std::lock_guard lock(config_cache_mutex);
+
+    // Reuse the previously parsed configuration for this plugin if the
+    // matched file has not been modified since
+    if (const auto cached = config_cache.find(yabridge_path.string());
+        cached != config_cache.end()) {
+        if (!cached->second.config_file) {
+            return cached->second.config;
+        }
+
+        boost::system::error_code err;
+        const std::time_t mtime =
+            fs::last_write_time(*cached->second.config_file, err);
+        if (!err && mtime == cached->second.mtime) {
+            return cached->second.config;
+        }
+
+        config_cache.erase(cached);
+    }
+
     // First find the closest `yabridge.tmol` file for the plugin, falling back
     // to default configuration settings if it doesn't exist
-    const std::optional<fs::path> config_file =
-        find_dominating_file("yabridge.toml", yabridge_path);
+    const std::string directory = yabridge_path.parent_path().string();
+    std::optional<fs::path> config_file;
+    if (const auto cached_file = config_file_cache.find(directory);
+        cached_file != config_file_cache.end() &&
+        (!cached_file->second || fs::exists(*cached_file->second))) {
+        config_file = cached_file->second;
+    } else {
+        config_file = find_dominating_file("yabridge.toml", yabridge_path);
+        config_file_cache[directory] = config_file;
+    }
+
     if (!config_file) {
+        config_cache[yabridge_path.string()] =
+            CachedConfiguration{Configuration(), std::nullopt, 0};
+
         return Configuration();
     }
 
-    return Configuration(*config_file, yabridge_path);
+    boost::system::error_code err;
+    const std::time_t mtime = fs::last_write_time(*config_file, err);
+    const Configuration config(*config_file, yabridge_path);
+    config_cache[yabridge_path.string()] =
+        CachedConfiguration{config, config_file, err ? 0 : mtime};
+
+    return config;
 }
 
 bp::environment set_wineprefix() {
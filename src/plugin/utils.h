@@ -60,7 +60,11 @@ std::string create_logger_prefix(
 
 /**
  * Determine the architecture of a VST plugin (or rather, a .dll file) based on
- * it's header values.
+ * it's header values. Since this gets called for every plugin instantiation
+ * and DAW plugin scans involve hundreds of .dll files, the result is stored
+ * in a persistent cache under `$XDG_CACHE_HOME/yabridge` keyed by the file's
+ * path, size and last modification time so repeated scans don't have to parse
+ * the same headers again.
  *
  * See https://docs.microsoft.com/en-us/windows/win32/debug/pe-format for more
  * information on the PE32 format.
@@ -152,7 +156,11 @@ boost::filesystem::path get_this_file_location();
 /**
  * Return the installed Wine version. This is obtained by from `wine --version`
  * and then stripping the `wine-` prefix. This respects the `WINELOADER`
- * environment variable used in the scripts generated by winegcc.
+ * environment variable used in the scripts generated by winegcc. The result
+ * is memoized process wide and also stored in a persistent cache under
+ * `$XDG_CACHE_HOME/yabridge` keyed by the Wine binary's last modification
+ * time, so at most one `wine --version` subprocess gets spawned per session
+ * instead of one per plugin instance.
  *
  * This will *not* throw when Wine can not be found, but will instead return
  * '<NOT FOUND>'. This way the user will still get some useful log files.
@@ -177,6 +185,12 @@ std::string join_quoted_strings(std::vector<std::string>& strings);
  * This function will take any optional compile-time features that have not been
  * enabled into account.
  *
+ * Parsed configurations are cached process wide so that the many instances
+ * loaded during a single project load don't repeat the same directory walks
+ * and TOML parses. Modifying a matched configuration file invalidates its
+ * entries, but a newly created `yabridge.toml` is only picked up by new
+ * sessions.
+ *
  * @param yabridge_path The path to the .so file that's being loaded.by the VST
  *   host. This will be used both for the starting location of the search and to
  *   determine which section in the config file to use.
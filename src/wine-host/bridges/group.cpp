@@ -105,19 +105,35 @@ GroupBridge::~GroupBridge() {
     stdio_context.stop();
 }
 
-void GroupBridge::handle_plugin_dispatch(size_t plugin_id) {
-    // At this point the `active_plugins` map will already contain the
-    // intialized plugin's `Vst2Bridge` instance and this thread's handle
-    Vst2Bridge* bridge;
-    {
+void GroupBridge::handle_plugin_dispatch(size_t plugin_id,
+                                         GroupRequest request) {
+    // Initialize the plugin on this thread. The `Vst2Bridge` constructor
+    // knows that the main context is already running and will post the
+    // plugin's entry point there itself, so the IO heavy parts of the
+    // initialization (loading the library, connecting the sockets and
+    // exchanging the configuration) can run concurrently when a project
+    // loads multiple plugins from the same group at once.
+    Vst2Bridge* bridge = nullptr;
+    try {
+        auto new_bridge = std::make_unique<Vst2Bridge>(
+            main_context, request.plugin_path, request.endpoint_base_dir,
+            true);
+        logger.log("Finished initializing '" + request.plugin_path + "'");
+
         std::lock_guard lock(active_plugins_mutex);
-        bridge = active_plugins[plugin_id].second.get();
+        bridge = new_bridge.get();
+        active_plugins[plugin_id].second = std::move(new_bridge);
+    } catch (const std::runtime_error& error) {
+        logger.log("Error while initializing '" + request.plugin_path + "':");
+        logger.log(error.what());
     }
 
-    // Blocks this thread until the plugin shuts down, handling all events on
-    // the main IO context
-    bridge->handle_dispatch();
-    logger.log("'" + bridge->vst_plugin_path.string() + "' has exited");
+    if (bridge) {
+        // Blocks this thread until the plugin shuts down, handling all events
+        // on the main IO context
+        bridge->handle_dispatch();
+        logger.log("'" + bridge->vst_plugin_path.string() + "' has exited");
+    }
 
     // After the plugin has exited we'll remove this thread's plugin from the
     // active plugins. This is done within the IO context because the call to
@@ -184,35 +200,20 @@ void GroupBridge::accept_requests() {
             const auto request = read_object<GroupRequest>(socket);
             write_object(socket, GroupResponse{boost::this_process::get_id()});
 
-            // The plugin has to be initiated on the IO context's thread because
-            // this has to be done on the same thread that's handling messages,
-            // and all window messages have to be handled from the same thread.
+            // The plugin gets initialized on its own thread so that multiple
+            // plugins can be loaded at the same time. The constructor posts
+            // the parts that have to interact with the Win32 message loop to
+            // this IO context itself, so only those parts are serialized.
+            // This way we can immediately go back to accepting new requests
+            // instead of blocking this handler for the entire initialization.
             logger.log("Received request to host '" + request.plugin_path +
                        "' using socket endpoint base directory '" +
                        request.endpoint_base_dir + "'");
-            try {
-                auto bridge = std::make_unique<Vst2Bridge>(
-                    main_context, request.plugin_path,
-                    request.endpoint_base_dir);
-                logger.log("Finished initializing '" + request.plugin_path +
-                           "'");
-
-                // Start listening for dispatcher events sent to the plugin's
-                // socket on another thread. The actual event handling will
-                // still be posted to this IO context so that every plugin's
-                // primary event handling happens on the main thread. Since this
-                // is only used within this context we don't need any locks.
-                const size_t plugin_id = next_plugin_id.fetch_add(1);
-                active_plugins[plugin_id] =
-                    std::pair(Win32Thread([this, plugin_id]() {
-                                  handle_plugin_dispatch(plugin_id);
-                              }),
-                              std::move(bridge));
-            } catch (const std::runtime_error& error) {
-                logger.log("Error while initializing '" + request.plugin_path +
-                           "':");
-                logger.log(error.what());
-            }
+            const size_t plugin_id = next_plugin_id.fetch_add(1);
+            active_plugins[plugin_id].first =
+                Win32Thread([this, plugin_id, request]() {
+                    handle_plugin_dispatch(plugin_id, request);
+                });
 
             accept_requests();
         });
@@ -220,12 +221,22 @@ void GroupBridge::accept_requests() {
 
 void GroupBridge::async_handle_events() {
     main_context.async_handle_events([&]() {
+        bool any_editor_open = false;
         {
             // Always handle X11 events
             std::lock_guard lock(active_plugins_mutex);
             for (auto& [parameters, value] : active_plugins) {
                 auto& [thread, bridge] = value;
+                // The bridge pointer stays null while the plugin is still
+                // being initialized on its worker thread (and when that
+                // initialization failed, until the posted cleanup removes
+                // the entry again)
+                if (!bridge) {
+                    continue;
+                }
+
                 bridge->handle_x11_events();
+                any_editor_open |= bridge->editor_is_open();
             }
         }
 
@@ -239,12 +250,19 @@ void GroupBridge::async_handle_events() {
         // loop for a little while after opening a second editor.  Without this
         // limit everything will get blocked indefinitely. How could this be
         // fixed?
-        for (int i = 0; i < max_win32_messages &&
-                        PeekMessage(&msg, nullptr, 0, 0, PM_REMOVE);
-             i++) {
+        int num_processed = 0;
+        for (; num_processed < max_win32_messages &&
+               PeekMessage(&msg, nullptr, 0, 0, PM_REMOVE);
+             num_processed++) {
             TranslateMessage(&msg);
             DispatchMessage(&msg);
         }
+
+        // With this the shared event loop drops to a slow heartbeat once none
+        // of the hosted plugins have an editor open and the message queue has
+        // gone quiet, so a group full of headless plugins sits at nearly zero
+        // CPU instead of polling an empty queue 60 times per second
+        return any_editor_open || num_processed > 0;
     });
 }
 
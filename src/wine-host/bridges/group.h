@@ -128,26 +128,32 @@ class GroupBridge {
     GroupBridge& operator=(const GroupBridge&) = delete;
 
     /**
-     * Run a plugin's dispatcher and message loop, processing all events on the
-     * main IO context. The plugin will have already been created in
-     * `accept_requests` since it has to be initiated inside of the IO context's
-     * thread.
+     * Initialize a plugin and then run its dispatcher loop, processing all
+     * events on the main IO context. The constructor posts the plugin's entry
+     * point to the IO context's thread itself, so multiple of these threads
+     * can initialize plugins at the same time without violating the Win32
+     * single GUI thread requirement. This is what makes loading a project
+     * with many plugins from the same group scale with the number of cores
+     * instead of being strictly serial.
      *
-     * Once the plugin has exited, this thread will then be joined to the main
-     * thread and removed from the `active_plugins` from the main IO context. If
-     * this causes the vector to become empty, we will terminate this process.
-     * This check is delayed by a few seconds to prevent having to constantly
-     * restart the group process during plugin scanning.
+     * Once the plugin has exited or if its initialization failed, this thread
+     * will be joined to the main thread and removed from the
+     * `active_plugins` from the main IO context. If this causes the vector to
+     * become empty, we will terminate this process. This check is delayed by
+     * a few seconds to prevent having to constantly restart the group process
+     * during plugin scanning.
      *
-     * @param plugin_id The ID of this plugin in the `active_plugins` map. The
-     *   thread can fetch the plugin's `Vst2Bridge` instance from that map using
-     *   this identifier.
+     * @param plugin_id The ID of this plugin in the `active_plugins` map.
+     *   This entry was created in `accept_requests` and the thread will store
+     *   the plugin's `Vst2Bridge` instance there after initialization.
+     * @param request The host request received in `accept_requests`,
+     *   containing the plugin to load and the socket endpoints to connect to.
      *
      * @note In the case that the process starts but no plugin gets initiated,
      *   then the process will never exit on its own. This should not happen
      *   though.
      */
-    void handle_plugin_dispatch(size_t plugin_id);
+    void handle_plugin_dispatch(size_t plugin_id, GroupRequest request);
 
     /**
      * Listen for new requests to spawn plugins within this process and handle
@@ -17,11 +17,14 @@
 #include "vst2.h"
 
 #include <boost/asio/dispatch.hpp>
+#include <boost/asio/post.hpp>
 #include <future>
 #include <iostream>
-#include <set>
 
 #include "../../common/communication.h"
+#include "../../common/opcode-traits.h"
+#include "../../common/profiling.h"
+#include "../../common/utils.h"
 
 /**
  * A function pointer to what should be the entry point of a VST plugin.
@@ -39,14 +42,6 @@ Vst2Bridge* current_bridge_instance = nullptr;
  */
 std::mutex current_bridge_instance_mutex;
 
-/**
- * Opcodes that should always be handled on the main thread because they may
- * involve GUI operations.
- */
-const std::set<int> unsafe_opcodes{effOpen,     effClose,     effEditGetRect,
-                                   effEditOpen, effEditClose, effEditIdle,
-                                   effEditTop};
-
 intptr_t VST_CALL_CONV
 host_callback_proxy(AEffect*, int, int, intptr_t, void*, float);
 
@@ -68,7 +63,8 @@ Vst2Bridge& get_bridge_instance(const AEffect* plugin) {
 
 Vst2Bridge::Vst2Bridge(MainContext& main_context,
                        std::string plugin_dll_path,
-                       std::string endpoint_base_dir)
+                       std::string endpoint_base_dir,
+                       bool main_context_running)
     : vst_plugin_path(plugin_dll_path),
       main_context(main_context),
       plugin_handle(LoadLibrary(plugin_dll_path.c_str()), FreeLibrary),
@@ -103,18 +99,36 @@ Vst2Bridge::Vst2Bridge(MainContext& main_context,
     // We'll try to do the same `get_bridge_isntance` trick as in
     // `plugin/plugin.cpp`, but since the plugin will probably call the host
     // callback while it's initializing we sadly have to use a global here.
-    {
+    //
+    // Calling the entry point is the only part of this constructor that has
+    // to run on the Win32 message loop's thread, since plugins may create
+    // windows and timers here. When the main context is already running on
+    // another thread we'll post this part there and wait for it to finish, so
+    // the IO heavy parts of multiple constructors can run concurrently in a
+    // group host process.
+    const auto call_entry_point = [&]() {
         std::lock_guard lock(current_bridge_instance_mutex);
         current_bridge_instance = this;
         plugin = vst_entry_point(host_callback_proxy);
-        if (!plugin) {
-            throw std::runtime_error("VST plugin at '" + plugin_dll_path +
-                                     "' failed to initialize.");
-        }
 
         // We only needed this little hack during initialization
         current_bridge_instance = nullptr;
-        plugin->ptr1 = this;
+        if (plugin) {
+            plugin->ptr1 = this;
+        }
+    };
+    if (main_context_running) {
+        std::packaged_task<void()> entry_point_task(call_entry_point);
+        std::future<void> entry_point_done = entry_point_task.get_future();
+        boost::asio::post(main_context.context,
+                          [&]() { entry_point_task(); });
+        entry_point_done.wait();
+    } else {
+        call_entry_point();
+    }
+    if (!plugin) {
+        throw std::runtime_error("VST plugin at '" + plugin_dll_path +
+                                 "' failed to initialize.");
     }
 
     // Send the plugin's information to the Linux VST plugin. Any other updates
@@ -128,46 +142,186 @@ Vst2Bridge::Vst2Bridge(MainContext& main_context,
     // configuration as a response
     config = sockets.host_vst_control.receive_single<Configuration>();
 
-    parameters_handler = Win32Thread([&]() {
-        sockets.host_vst_parameters.receive_multi<Parameter>(
-            [&](Parameter request, std::vector<uint8_t>& buffer) {
-                // Both `getParameter` and `setParameter` functions are passed
-                // through on this socket since they have a lot of overlap. The
-                // presence of the `value` field tells us which one we're
-                // dealing with.
-                if (request.value) {
-                    // `setParameter`
-                    plugin->setParameter(plugin, request.index, *request.value);
-
-                    ParameterResult response{std::nullopt};
-                    sockets.host_vst_parameters.send(response, buffer);
-                } else {
-                    // `getParameter`
-                    float value = plugin->getParameter(plugin, request.index);
+    // The plugin will have created a shared memory file for the audio buffers
+    // right after its sockets were connected to. If we can map it we'll use
+    // that for audio processing instead of the process replacing socket, which
+    // saves two serialization passes and two copies of every buffer. We'll
+    // report back whether this worked so both sides end up using the same
+    // transport.
+    try {
+        audio_shm.emplace(sockets.base_dir / audio_shm_filename, false);
+    } catch (const std::system_error& error) {
+        std::cerr << "Could not map the shared memory audio buffers, falling "
+                     "back to socket based audio processing:"
+                  << std::endl;
+        std::cerr << error.what() << std::endl;
+    }
+
+    sockets.host_vst_control.send(AudioShmStatus{audio_shm.has_value()});
 
-                    ParameterResult response{value};
-                    sockets.host_vst_parameters.send(response, buffer);
+    // When enabled, the audio processing loop will spin for a bit before
+    // blocking so we don't pay for a scheduler wakeup on every block
+    if (config.low_latency_spin) {
+        if (audio_shm) {
+            audio_shm->set_spin_duration(low_latency_spin_duration);
+        }
+        sockets.host_vst_process_replacing.set_spin_duration(
+            low_latency_spin_duration);
+    }
+
+    parameters_handler = Win32Thread([&]() {
+        // The response object is kept around so the batch's heap allocation
+        // can be reused between messages
+        ParameterBatchResult response{};
+        sockets.host_vst_parameters.receive_multi<ParameterBatch>(
+            [&](ParameterBatch& request, std::vector<uint8_t>& buffer) {
+                // Both `getParameter` and `setParameter` calls are passed
+                // through on this socket since they have a lot of overlap, and
+                // the plugin side coalesces multiple calls into a single
+                // batch. The presence of the `value` field tells us which of
+                // the two functions we're dealing with.
+                response.results.clear();
+                for (const Parameter& parameter : request.parameters) {
+                    if (parameter.value) {
+                        // `setParameter`
+                        plugin->setParameter(plugin, parameter.index,
+                                             *parameter.value);
+
+                        response.results.push_back(
+                            ParameterResult{std::nullopt});
+                    } else {
+                        // `getParameter`
+                        float value =
+                            plugin->getParameter(plugin, parameter.index);
+
+                        response.results.push_back(ParameterResult{value});
+                    }
                 }
+
+                sockets.host_vst_parameters.send(response, buffer);
             });
     });
 
     process_replacing_handler = Win32Thread([&]() {
-        // These are used as scratch buffers to prevent unnecessary allocations.
-        // Since don't know in advance whether the host will call
-        // `processReplacing` or `processDoubleReplacing` we'll just create
-        // both.
-        std::vector<std::vector<float>> output_buffers_single_precision(
-            plugin->numOutputs);
-        std::vector<std::vector<double>> output_buffers_double_precision(
-            plugin->numOutputs);
+        if (audio_shm) {
+            // When the shared memory audio buffers are active, the plugin
+            // writes its input buffers directly into the mapping and rings a
+            // doorbell. We can then process the audio completely in place by
+            // just building channel pointers into the mapping, so this side
+            // does not have to copy any audio at all.
+            std::vector<float*> inputs_single_precision;
+            std::vector<float*> outputs_single_precision;
+            std::vector<double*> inputs_double_precision;
+            std::vector<double*> outputs_double_precision;
+
+            uint32_t last_request = audio_shm->header()->request_counter.load(
+                std::memory_order_acquire);
+            while (const auto request_counter =
+                       audio_shm->wait_for_request(last_request)) {
+                last_request = *request_counter;
+
+                // The plugin will have grown the backing file if the buffers
+                // did not fit yet
+                audio_shm->remap_if_grown();
+                AudioShmBuffer::Header* header = audio_shm->header();
+                const int sample_frames = header->sample_frames;
+
+                // The plugin side sends a snapshot of the host's transport
+                // information along with every block so we can serve
+                // `audioMasterGetTime()` calls locally during processing
+                if (header->time_info_valid != 0) {
+                    time_info_snapshot = header->time_info;
+                    time_info_snapshot_active.store(true,
+                                                    std::memory_order_release);
+                }
+
+                if (header->double_precision) {
+                    double* input_base =
+                        reinterpret_cast<double*>(audio_shm->data());
+                    double* output_base =
+                        input_base +
+                        (static_cast<size_t>(header->num_input_channels) *
+                         sample_frames);
+
+                    inputs_double_precision.clear();
+                    for (uint32_t channel = 0;
+                         channel < header->num_input_channels; channel++) {
+                        inputs_double_precision.push_back(
+                            input_base + (channel * sample_frames));
+                    }
+                    outputs_double_precision.clear();
+                    for (uint32_t channel = 0;
+                         channel < header->num_output_channels; channel++) {
+                        outputs_double_precision.push_back(
+                            output_base + (channel * sample_frames));
+                    }
+
+                    process_audio(inputs_double_precision.data(),
+                                  outputs_double_precision.data(),
+                                  sample_frames);
+                } else {
+                    float* input_base =
+                        reinterpret_cast<float*>(audio_shm->data());
+                    float* output_base =
+                        input_base +
+                        (static_cast<size_t>(header->num_input_channels) *
+                         sample_frames);
+
+                    inputs_single_precision.clear();
+                    for (uint32_t channel = 0;
+                         channel < header->num_input_channels; channel++) {
+                        inputs_single_precision.push_back(
+                            input_base + (channel * sample_frames));
+                    }
+                    outputs_single_precision.clear();
+                    for (uint32_t channel = 0;
+                         channel < header->num_output_channels; channel++) {
+                        outputs_single_precision.push_back(
+                            output_base + (channel * sample_frames));
+                    }
+
+                    process_audio(inputs_single_precision.data(),
+                                  outputs_single_precision.data(),
+                                  sample_frames);
+                }
+
+                // Release the MIDI events that were passed to the plugin
+                // before this buffer. This approach should not be needed but
+                // Kontakt only stores pointers to rather than copies of the
+                // events, so they have to outlive the processing call.
+                next_audio_buffer_midi_events.release_all();
+                time_info_snapshot_active.store(false,
+                                                std::memory_order_release);
+
+                audio_shm->notify_response();
+            }
+
+            return;
+        }
+
+        // This response object is persistent so its flat audio buffer can be
+        // reused between processing cycles, just like the request object that
+        // `receive_multi()` deserializes into
+        AudioBuffers response{};
+
+        // These hold the per-channel pointers into the flat buffers that the
+        // plugin's process functions expect
+        std::vector<float*> inputs_single_precision;
+        std::vector<float*> outputs_single_precision;
+        std::vector<double*> inputs_double_precision;
+        std::vector<double*> outputs_double_precision;
 
         sockets.host_vst_process_replacing.receive_multi<AudioBuffers>(
-            [&](AudioBuffers request, std::vector<uint8_t>& buffer) {
-                // Let the plugin process the MIDI events that were received
-                // since the last buffer, and then clean up those events. This
-                // approach should not be needed but Kontakt only stores
-                // pointers to rather than copies of the events.
-                std::lock_guard lock(next_buffer_midi_events_mutex);
+            [&](AudioBuffers& request, std::vector<uint8_t>& buffer) {
+                // Just like on the shared memory path, the request includes a
+                // snapshot of the host's transport information so
+                // `audioMasterGetTime()` can be served locally while the
+                // plugin is processing
+                if (request.time_info) {
+                    time_info_snapshot = *request.time_info;
+                    time_info_snapshot_active.store(true,
+                                                    std::memory_order_release);
+                }
 
                 // Since the host should only be calling one of `process()`,
                 // processReplacing()` or `processDoubleReplacing()`, we can all
@@ -176,92 +330,100 @@ Vst2Bridge::Vst2Bridge(MainContext& main_context,
                 // reported support for these functions.
                 std::visit(
                     overload{
-                        [&](std::vector<std::vector<float>>& input_buffers) {
-                            // The process functions expect a `float**` for
-                            // their inputs and their outputs
-                            std::vector<float*> inputs;
-                            for (auto& buffer : input_buffers) {
-                                inputs.push_back(buffer.data());
+                        [&](std::vector<float>&) {
+                            inputs_single_precision.clear();
+                            for (int channel = 0; channel < request.num_channels;
+                                 channel++) {
+                                inputs_single_precision.push_back(
+                                    request.channel<float>(channel));
                             }
 
-                            // We reuse the buffers to avoid some unnecessary
-                            // heap allocations, so we need to make sure the
-                            // buffers are large enough since plugins can change
-                            // their output configuration. The type we're using
-                            // here (single precision floats vs double
-                            // precisioon doubles) should be the same as the one
-                            // we're sending in our response.
-                            std::vector<float*> outputs;
-                            output_buffers_single_precision.resize(
-                                plugin->numOutputs);
-                            for (auto& buffer :
-                                 output_buffers_single_precision) {
-                                buffer.resize(request.sample_frames);
-                                outputs.push_back(buffer.data());
+                            // The response's flat buffer is persistent, so we
+                            // only need to make sure it is large enough since
+                            // plugins can change their output configuration.
+                            // The type we're using here (single precision
+                            // floats vs double precisioon doubles) should be
+                            // the same as the one we got sent.
+                            response.resize_to<float>(plugin->numOutputs,
+                                                      request.sample_frames);
+                            outputs_single_precision.clear();
+                            for (int channel = 0; channel < plugin->numOutputs;
+                                 channel++) {
+                                outputs_single_precision.push_back(
+                                    response.channel<float>(channel));
                             }
 
-                            // Any plugin made in the last fifteen years or so
-                            // should support `processReplacing`. In the off
-                            // chance it does not we can just emulate this
-                            // behavior ourselves.
-                            if (plugin->processReplacing) {
-                                plugin->processReplacing(plugin, inputs.data(),
-                                                         outputs.data(),
-                                                         request.sample_frames);
-                            } else {
-                                // If we zero out this buffer then the behavior
-                                // is the same as `processReplacing``
-                                for (std::vector<float>& buffer :
-                                     output_buffers_single_precision) {
-                                    std::fill(buffer.begin(), buffer.end(),
-                                              0.0);
-                                }
-
-                                plugin->process(plugin, inputs.data(),
-                                                outputs.data(),
-                                                request.sample_frames);
-                            }
+                            process_audio(inputs_single_precision.data(),
+                                          outputs_single_precision.data(),
+                                          request.sample_frames);
 
-                            AudioBuffers response{
-                                output_buffers_single_precision,
-                                request.sample_frames};
                             sockets.host_vst_process_replacing.send(response,
                                                                     buffer);
                         },
-                        [&](std::vector<std::vector<double>>& input_buffers) {
+                        [&](std::vector<double>&) {
                             // Exactly the same as the above, but for double
                             // precision audio
-                            std::vector<double*> inputs;
-                            for (auto& buffer : input_buffers) {
-                                inputs.push_back(buffer.data());
+                            inputs_double_precision.clear();
+                            for (int channel = 0; channel < request.num_channels;
+                                 channel++) {
+                                inputs_double_precision.push_back(
+                                    request.channel<double>(channel));
                             }
 
-                            std::vector<double*> outputs;
-                            output_buffers_double_precision.resize(
-                                plugin->numOutputs);
-                            for (auto& buffer :
-                                 output_buffers_double_precision) {
-                                buffer.resize(request.sample_frames);
-                                outputs.push_back(buffer.data());
+                            response.resize_to<double>(plugin->numOutputs,
+                                                       request.sample_frames);
+                            outputs_double_precision.clear();
+                            for (int channel = 0; channel < plugin->numOutputs;
+                                 channel++) {
+                                outputs_double_precision.push_back(
+                                    response.channel<double>(channel));
                             }
 
-                            plugin->processDoubleReplacing(
-                                plugin, inputs.data(), outputs.data(),
-                                request.sample_frames);
+                            process_audio(inputs_double_precision.data(),
+                                          outputs_double_precision.data(),
+                                          request.sample_frames);
 
-                            AudioBuffers response{
-                                output_buffers_double_precision,
-                                request.sample_frames};
                             sockets.host_vst_process_replacing.send(response,
                                                                     buffer);
                         }},
                     request.buffers);
 
-                next_audio_buffer_midi_events.clear();
+                // Release the MIDI events that were passed to the plugin
+                // before this buffer. This approach should not be needed but
+                // Kontakt only stores pointers to rather than copies of the
+                // events, so they have to outlive the processing call.
+                next_audio_buffer_midi_events.release_all();
+                time_info_snapshot_active.store(false,
+                                                std::memory_order_release);
             });
     });
 }
 
+void Vst2Bridge::process_audio(float** inputs,
+                               float** outputs,
+                               int sample_frames) {
+    // Any plugin made in the last fifteen years or so should support
+    // `processReplacing`. In the off chance it does not we can just emulate
+    // this behavior ourselves.
+    if (plugin->processReplacing) {
+        plugin->processReplacing(plugin, inputs, outputs, sample_frames);
+    } else {
+        // If we zero out the buffers then the behavior is the same as
+        // `processReplacing`
+        for (int channel = 0; channel < plugin->numOutputs; channel++) {
+            std::fill(outputs[channel], outputs[channel] + sample_frames, 0.0);
+        }
+
+        plugin->process(plugin, inputs, outputs, sample_frames);
+    }
+}
+
+void Vst2Bridge::process_audio(double** inputs,
+                               double** outputs,
+                               int sample_frames) {
+    plugin->processDoubleReplacing(plugin, inputs, outputs, sample_frames);
+}
+
 void Vst2Bridge::handle_dispatch() {
     sockets.host_vst_dispatch.receive_events(
         std::nullopt, [&](Event& event, bool /*on_main_thread*/) {
@@ -276,11 +438,8 @@ void Vst2Bridge::handle_dispatch() {
                 // we need to store a copy of the `DynamicVstEvents` struct
                 // before passing the generated `VstEvents` object to the
                 // plugin.
-                std::lock_guard lock(next_buffer_midi_events_mutex);
-
-                next_audio_buffer_midi_events.push_back(
+                DynamicVstEvents& events = next_audio_buffer_midi_events.push(
                     std::get<DynamicVstEvents>(event.payload));
-                DynamicVstEvents& events = next_audio_buffer_midi_events.back();
 
                 // Exact same handling as in `passthrough_event()`, apart
                 // from making a copy of the events first
@@ -319,7 +478,7 @@ void Vst2Bridge::handle_dispatch() {
                         // context, since this is also where the plugins were
                         // instantiated and where the Win32 message loop is
                         // handled.
-                        if (unsafe_opcodes.contains(opcode)) {
+                        if (dispatch_opcode_traits(opcode).needs_main_thread) {
                             std::promise<intptr_t> dispatch_result;
                             boost::asio::dispatch(main_context.context, [&]() {
                                 const intptr_t result = dispatch_wrapper(
@@ -337,6 +496,14 @@ void Vst2Bridge::handle_dispatch() {
                     event);
             }
         });
+
+    // When profiling is enabled, report the Wine side's accumulated latency
+    // histograms now that the sockets have closed. This goes through this
+    // process's STDERR, which the Linux side relays to the actual log.
+    if (EventProfiler* profiler = EventProfiler::instance()) {
+        Logger logger = Logger::create_from_environment();
+        profiler->dump(logger);
+    }
 }
 
 intptr_t Vst2Bridge::dispatch_wrapper(AEffect* plugin,
@@ -381,18 +548,25 @@ intptr_t Vst2Bridge::dispatch_wrapper(AEffect* plugin,
     }
 }
 
-void Vst2Bridge::handle_win32_events() {
+bool Vst2Bridge::handle_win32_events() {
     if (editor) {
         editor->handle_win32_events();
+
+        // With an open editor the event loop should always run at the full
+        // cadence, even during ticks where no messages came in
+        return true;
     } else {
         MSG msg;
 
-        for (int i = 0; i < max_win32_messages &&
-                        PeekMessage(&msg, nullptr, 0, 0, PM_REMOVE);
-             i++) {
+        int num_processed = 0;
+        for (; num_processed < max_win32_messages &&
+               PeekMessage(&msg, nullptr, 0, 0, PM_REMOVE);
+             num_processed++) {
             TranslateMessage(&msg);
             DispatchMessage(&msg);
         }
+
+        return num_processed > 0;
     }
 }
 
@@ -412,25 +586,24 @@ class HostCallbackDataConverter : DefaultDataConverter {
                       const int index,
                       const intptr_t value,
                       const void* data) const override {
-        switch (opcode) {
-            case audioMasterGetTime:
+        switch (host_callback_opcode_traits(opcode).payload) {
+            case Vst2PayloadKind::wants_time_info:
                 return WantsVstTimeInfo{};
                 break;
-            case audioMasterIOChanged:
-                // This is a helpful event that indicates that the VST
-                // plugin's `AEffect` struct has changed. Writing these
-                // results back is done inside of `passthrough_event()`.
+            case Vst2PayloadKind::aeffect:
+                // `audioMasterIOChanged` is a helpful event that indicates
+                // that the VST plugin's `AEffect` struct has changed. Writing
+                // these results back is done inside of `passthrough_event()`.
                 return AEffect(*plugin);
                 break;
-            case audioMasterProcessEvents:
+            case Vst2PayloadKind::midi_events:
                 return DynamicVstEvents(*static_cast<const VstEvents*>(data));
                 break;
             // We detect whether an opcode should return a string by
             // checking whether there's a zeroed out buffer behind the void
             // pointer. This works for any host, but not all plugins zero
             // out their buffers.
-            case audioMasterGetVendorString:
-            case audioMasterGetProductString:
+            case Vst2PayloadKind::wants_string:
                 return WantsString{};
                 break;
             default:
@@ -447,9 +620,9 @@ class HostCallbackDataConverter : DefaultDataConverter {
 
     void write(const int opcode,
                void* data,
-               const EventResult& response) const override {
-        switch (opcode) {
-            case audioMasterGetTime:
+               EventResult& response) const override {
+        switch (host_callback_opcode_traits(opcode).response) {
+            case Vst2PayloadKind::time_info:
                 // Write the returned `VstTimeInfo` struct into a field and
                 // make the function return a poitner to it in the function
                 // below. Depending on whether the host supported the
@@ -469,8 +642,8 @@ class HostCallbackDataConverter : DefaultDataConverter {
 
     intptr_t return_value(const int opcode,
                           const intptr_t original) const override {
-        switch (opcode) {
-            case audioMasterGetTime: {
+        switch (host_callback_opcode_traits(opcode).response) {
+            case Vst2PayloadKind::time_info: {
                 // Return a pointer to the `VstTimeInfo` object written in
                 // the function above
                 VstTimeInfo* time_info_pointer = nullptr;
@@ -488,7 +661,7 @@ class HostCallbackDataConverter : DefaultDataConverter {
 
     void write_value(const int opcode,
                      intptr_t value,
-                     const EventResult& response) const override {
+                     EventResult& response) const override {
         return DefaultDataConverter::write_value(opcode, value, response);
     }
 
@@ -503,6 +676,17 @@ intptr_t Vst2Bridge::host_callback(AEffect* effect,
                                    intptr_t value,
                                    void* data,
                                    float option) {
+    // Plugins call `audioMasterGetTime()` at least once for every processing
+    // cycle (and some call it once per MIDI event), so the plugin side sends
+    // us a snapshot of the time info along with every block. While we're
+    // inside of a processing call we can serve these calls from that snapshot
+    // without any socket round trips.
+    if (opcode == audioMasterGetTime &&
+        time_info_snapshot_active.load(std::memory_order_acquire)) {
+        time_info = time_info_snapshot;
+        return reinterpret_cast<intptr_t>(&*time_info);
+    }
+
     HostCallbackDataConverter converter(effect, time_info);
     return sockets.vst_host_callback.send_event(converter, std::nullopt, opcode,
                                                 index, value, data, option);
@@ -29,9 +29,11 @@
 #include <boost/asio/local/stream_protocol.hpp>
 #include <mutex>
 
+#include "../../common/audio-shm.h"
 #include "../../common/communication.h"
 #include "../../common/configuration.h"
 #include "../../common/logging.h"
+#include "../../common/midi-queue.h"
 #include "../editor.h"
 #include "../utils.h"
 
@@ -60,16 +62,25 @@ class Vst2Bridge {
      *   load.
      * @param endpoint_base_dir The base directory used for the socket
      *   endpoints. See `Sockets` for more information.
+     * @param main_context_running Whether `main_context.run()` is already
+     *   being called on another thread, as is the case in group host
+     *   processes. When set, the plugin's entry point gets posted to
+     *   `main_context` while the rest of the constructor (loading the
+     *   library, connecting the sockets and exchanging the configuration)
+     *   runs on the calling thread. This allows a group host to initialize
+     *   multiple plugins concurrently while keeping all Win32/GUI
+     *   interaction on the main thread.
      *
-     * @note The object has to be constructed from the same thread that calls
-     *   `main_context.run()`.
+     * @note When `main_context_running` is false, the object has to be
+     *   constructed from the same thread that calls `main_context.run()`.
      *
      * @throw std::runtime_error Thrown when the VST plugin could not be loaded,
      *   or if communication could not be set up.
      */
     Vst2Bridge(MainContext& main_context,
                std::string plugin_dll_path,
-               std::string endpoint_base_dir);
+               std::string endpoint_base_dir,
+               bool main_context_running = false);
 
     /**
      * Handle events until the plugin exits. The actual events are posted to
@@ -105,8 +116,25 @@ class Vst2Bridge {
      * specific situation that can cause a race condition in some plugins
      * because of incorrect assumptions made by the plugin. See the dostring for
      * `Vst2Bridge::editor` for more information.
+     *
+     * @return Whether there was any GUI work this tick, i.e. the editor is
+     *   open or at least one message was processed. Used by the event loop to
+     *   decide when it can drop to its idle heartbeat.
+     *
+     * @see MainContext::async_handle_events
+     */
+    bool handle_win32_events();
+
+    /**
+     * Whether the plugin's editor is currently open. Used by the group host's
+     * shared event loop for the same cadence decision as the return value of
+     * `handle_win32_events()`. Should only be called from the thread running
+     * `main_context`, since that's also where the editor gets opened and
+     * closed.
+     *
+     * @see MainContext::async_handle_events
      */
-    void handle_win32_events();
+    bool editor_is_open() const noexcept { return editor.has_value(); }
 
     /**
      * Forward the host callback made by the plugin to the host and return the
@@ -139,6 +167,37 @@ class Vst2Bridge {
                               void* data,
                               float option);
 
+    /**
+     * Let the plugin process a single buffer of audio, falling back to the
+     * old accumulative `process()` function in the off chance the plugin does
+     * not support `processReplacing()`. Used by both the shared memory audio
+     * processing loop and the socket based fallback.
+     */
+    void process_audio(float** inputs, float** outputs, int sample_frames);
+    /**
+     * The same as the above, but for double precision audio through
+     * `processDoubleReplacing()`.
+     */
+    void process_audio(double** inputs, double** outputs, int sample_frames);
+
+    /**
+     * A snapshot of the host's `VstTimeInfo` that the plugin side sends along
+     * with every audio processing request, since the time info only changes
+     * in between blocks. Used to serve `audioMasterGetTime()` calls made
+     * during the processing call without a socket round trip. Only written by
+     * the audio processing thread, and only valid while
+     * `time_info_snapshot_active` is set.
+     */
+    VstTimeInfo time_info_snapshot;
+    /**
+     * Whether `time_info_snapshot` may be used to answer
+     * `audioMasterGetTime()`. This is only set for the duration of a
+     * processing call, since that's the window during which the snapshot is
+     * guaranteed to match what the host would return. Calls made at any other
+     * time take the usual socket round trip.
+     */
+    std::atomic_bool time_info_snapshot_active = false;
+
     /**
      * The IO context used for event handling so that all events and window
      * message handling can be performed from a single thread, even when hosting
@@ -185,19 +244,35 @@ class Vst2Bridge {
      */
     Sockets<Win32Thread> sockets;
 
+    /**
+     * The shared memory buffer used to pass audio between the native plugin
+     * and this process without any serialization. The file is created by the
+     * plugin and mapped here during initialization. If the mapping fails on
+     * either side, this will be empty and the audio buffers will be sent over
+     * the `host_vst_process_replacing` socket instead.
+     *
+     * NOTE: Just like the sockets this is defined after the threads on
+     *       purpose. Destroying this object signals a shutdown through the
+     *       mapping, which unblocks the `process_replacing_handler` thread's
+     *       futex wait so it can be joined.
+     *
+     * @see AudioShmBuffer
+     */
+    std::optional<AudioShmBuffer> audio_shm;
+
     /**
      * The MIDI events that have been received **and processed** since the last
      * call to `processReplacing()`. 99% of plugins make a copy of the MIDI
      * events they receive but some plugins such as Kontakt only store pointers
      * to these events, which means that the actual `VstEvent` objects must live
-     * at least until the next audio buffer gets processed.
-     */
-    std::vector<DynamicVstEvents> next_audio_buffer_midi_events;
-    /**
-     * Mutex for locking the above event queue, since recieving and processing
-     * now happens in two different threads.
+     * at least until the next audio buffer gets processed. Since receiving and
+     * processing happen on two different threads this is a lock-free queue, so
+     * dense MIDI streams can never block the audio thread. The queue's slots
+     * are not rewritten until the dispatcher has pushed another
+     * `MidiEventQueue::midi_queue_capacity` batches, which keeps released
+     * events alive for long enough.
      */
-    std::mutex next_buffer_midi_events_mutex;
+    MidiEventQueue next_audio_buffer_midi_events;
 
     /**
      * The plugin editor window. Allows embedding the plugin's editor into a
@@ -16,11 +16,113 @@
 
 #include "editor.h"
 
+#include <algorithm>
 #include <iostream>
+#include <utility>
+#include <vector>
 
 // The Win32 API requires you to hardcode identifiers for tiemrs
 constexpr size_t idle_timer_id = 1337;
 
+/**
+ * A process wide scheduler that drives `effEditIdle` for every open editor
+ * from a single Win32 timer. Every editor used to own its own 100 ms timer,
+ * and with several editors open in one plugin group those timers would
+ * interleave and cause a separate wakeup and render cascade for each of them.
+ * Batching all idle updates into a single pass aligned to one deadline cuts
+ * this down to one wakeup per interval, and it also lets Wine batch the
+ * resulting GDI work.
+ *
+ * The Win32 API will block the `DispatchMessage` call when opening e.g. a
+ * dropdown, but it will still allow timers to be run so the GUIs can still
+ * update in the background. That's the reason these idle updates are driven
+ * by a Win32 timer instead of by our own event loop, and it's also why the
+ * timer has to be attached to one of the open editor windows. When the editor
+ * hosting the timer closes, the timer simply moves to another open editor.
+ * The refresh rate is purposely fairly low since the host will call
+ * `effEditIdle()` explicitely when the plugin is not busy.
+ *
+ * Editors are created, destroyed and idled from the thread that runs the
+ * Win32 message loop, so none of this needs any synchronisation.
+ */
+class EditorIdleScheduler {
+   public:
+    /**
+     * Register an editor that was just opened, starting the shared timer on
+     * its window when it's the first one.
+     *
+     * @param editor The editor that should receive periodic `effEditIdle`
+     *   calls.
+     * @param window The editor's Wine window. Used to host the shared timer.
+     */
+    void register_editor(Editor& editor, HWND window) {
+        editors.emplace_back(&editor, window);
+
+        if (!timer) {
+            attach_timer(window);
+        }
+    }
+
+    /**
+     * Remove an editor that's being closed, moving the shared timer to
+     * another open editor if this one was hosting it.
+     */
+    void unregister_editor(const Editor& editor, HWND window) {
+        editors.erase(std::remove_if(editors.begin(), editors.end(),
+                                     [&](const auto& candidate) {
+                                         return candidate.first == &editor;
+                                     }),
+                      editors.end());
+
+        if (window == timer_window_handle) {
+            // The timer has to be destroyed before its window is, and
+            // recreated on a window that will stay alive
+            timer.reset();
+            timer_window_handle = nullptr;
+            if (!editors.empty()) {
+                attach_timer(editors.front().second);
+            }
+        }
+    }
+
+    /**
+     * Send a single `effEditIdle` to every open editor. Called whenever the
+     * shared timer ticks.
+     */
+    void send_idle_events() const {
+        for (const auto& [editor, window] : editors) {
+            editor->send_idle_event();
+        }
+    }
+
+    /**
+     * The window the shared timer is currently attached to, or a null pointer
+     * when no editors are open. The message loops use this to filter out the
+     * timer's messages.
+     */
+    HWND timer_window() const noexcept { return timer_window_handle; }
+
+   private:
+    void attach_timer(HWND window) {
+        timer.emplace(window, idle_timer_id, 100);
+        timer_window_handle = window;
+    }
+
+    /**
+     * All currently open editors and their Wine windows, in the order they
+     * were opened.
+     */
+    std::vector<std::pair<Editor*, HWND>> editors;
+
+    std::optional<Win32Timer> timer;
+    HWND timer_window_handle = nullptr;
+};
+
+/**
+ * The scheduler for all editors hosted by this process.
+ */
+EditorIdleScheduler editor_idle_scheduler{};
+
 /**
  * The most significant bit in an event's response type is used to indicate
  * whether the event source.
@@ -110,7 +212,6 @@ Editor::Editor(const Configuration& config,
       // If `config.editor_double_embed` is set, then we'll also create a child
       // window in `win32_child_handle`. If we do this before calling
       // `ShowWindow()` on `win32_handle` we'll run into X11 errors.
-      idle_timer(win32_handle.get(), idle_timer_id, 100),
       parent_window(parent_window_handle),
       wine_window(get_x11_handle(win32_handle.get())),
       topmost_window(find_topmost_window(*x11_connection, parent_window)),
@@ -190,9 +291,17 @@ Editor::Editor(const Configuration& config,
     //       https://github.com/robot-vdh/yabridge/issues/40
     xcb_reparent_window(x11_connection.get(), wine_window, parent_window, 0, 0);
     xcb_flush(x11_connection.get());
+
+    // The shared idle timer will now also keep this editor updated during
+    // blocking GUI operations
+    editor_idle_scheduler.register_editor(*this, win32_handle.get());
 }
 
 Editor::~Editor() {
+    // This also moves the shared idle timer to another editor if this window
+    // was hosting it, since the timer has to outlive its window
+    editor_idle_scheduler.unregister_editor(*this, win32_handle.get());
+
     // Wine will wait for the parent window to properly delete the window during
     // `DestroyWindow()`. Instead of implementing this behavior ourselves we
     // just reparent the window back to the window root and let the WM handle
@@ -235,15 +344,16 @@ void Editor::handle_win32_events() const {
     for (int i = 0;
          i < max_win32_messages && PeekMessage(&msg, nullptr, 0, 0, PM_REMOVE);
          i++) {
-        // This timer would periodically send `effEditIdle` events so the editor
-        // remains responsive even during blocking GUI operations such as open
-        // dropdowns or message boxes. This is only needed when the GUI is
-        // actually blocked and it will be dispatched by the messaging loop of
-        // the blocking GUI component. Since we're not touching the
+        // The shared timer would periodically send `effEditIdle` events so the
+        // editors remain responsive even during blocking GUI operations such
+        // as open dropdowns or message boxes. This is only needed when the GUI
+        // is actually blocked and it will be dispatched by the messaging loop
+        // of the blocking GUI component. Since we're not touching the
         // `effEditIdle` event sent by the host we can always filter this timer
-        // event out in this event loop.
+        // event out in this event loop. The timer may be attached to any open
+        // editor's window, so we have to ask the scheduler which one that is.
         if (msg.message == WM_TIMER && msg.wParam == idle_timer_id &&
-            msg.hwnd == win32_handle.get()) {
+            msg.hwnd == editor_idle_scheduler.timer_window()) {
             continue;
         }
 
@@ -467,17 +577,17 @@ LRESULT CALLBACK window_proc(HWND handle,
                              reinterpret_cast<size_t>(editor));
         } break;
         case WM_TIMER: {
-            auto editor = reinterpret_cast<Editor*>(
-                GetWindowLongPtr(handle, GWLP_USERDATA));
-            if (!editor || wParam != idle_timer_id) {
+            if (wParam != idle_timer_id) {
                 break;
             }
 
-            // We'll send idle messages on a timer. This way the plugin will get
-            // keep periodically updating its editor either when the host sends
-            // `effEditIdle` themself, or periodically when the GUI is being
-            // blocked by a dropdown or a message box.
-            editor->send_idle_event();
+            // We'll send idle messages on a timer. This way the plugins will
+            // keep periodically updating their editors either when the host
+            // sends `effEditIdle` themself, or periodically when the GUI is
+            // being blocked by a dropdown or a message box. The timer is
+            // shared between every open editor, so a single tick updates all
+            // of them in one aligned pass.
+            editor_idle_scheduler.send_idle_events();
             return 0;
         } break;
         // In case the WM does not support the EWMH active window property,
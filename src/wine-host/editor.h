@@ -216,15 +216,6 @@ class Editor {
         std::unique_ptr<std::remove_pointer_t<HWND>, decltype(&DestroyWindow)>>
         win32_child_handle;
 
-    /**
-     * The Win32 API will block the `DispatchMessage` call when opening e.g. a
-     * dropdown, but it will still allow timers to be run so the GUI can still
-     * update in the background. Because of this we send `effEditIdle` to the
-     * plugin on a timer. The refresh rate is purposely fairly low since the
-     * host will call `effEditIdle()` explicitely when the plugin is not busy.
-     */
-    Win32Timer idle_timer;
-
     /**
      * The window handle of the editor window created by the DAW.
      */
@@ -14,13 +14,18 @@
 // You should have received a copy of the GNU General Public License
 // along with this program.  If not, see <https://www.gnu.org/licenses/>.
 
+#include "boost-fix.h"
+
 #include <iostream>
 #include <thread>
 
+#include <boost/process/environment.hpp>
+
 // Generated inside of the build directory
 #include <src/common/config/config.h>
 #include <src/common/config/version.h>
 
+#include "../common/communication.h"
 #include "../common/utils.h"
 #include "bridges/vst2.h"
 
@@ -29,6 +34,13 @@
  * plugin, and then connect back to the `libyabridge.so` instance that spawned
  * this over the socket.
  *
+ * When started with only a single argument this process runs in pooled mode
+ * instead. It will then connect to the pool socket denoted by that argument,
+ * identify itself with its PID and wait until a yabridge instance claims it
+ * and tells it which plugin to load. Since the expensive part of starting a
+ * host process is bringing up the Wine environment, this lets `libyabridge.so`
+ * pre-warm host processes before they are needed.
+ *
  * The explicit calling convention is needed to work around a bug introduced in
  * Wine 5.7: https://bugs.winehq.org/show_bug.cgi?id=49138
  */
@@ -37,28 +49,66 @@ int __cdecl main(int argc, char* argv[]) {
 
     // We pass the name of the VST plugin .dll file to load and the base
     // directory for the Unix domain socket endpoints to connect to as the first
-    // two arguments of this process in plugin/bridge.cpp.
-    if (argc < 3) {
+    // two arguments of this process in plugin/bridge.cpp. When this process
+    // was spawned by a `HostProcessPool` we instead get the path of the pool
+    // socket to fetch those same parameters from.
+    if (argc < 2) {
         std::cerr << "Usage: "
 #ifdef __i386__
                   << yabridge_individual_host_name_32bit
 #else
                   << yabridge_individual_host_name
 #endif
-                  << " <vst_plugin_dll> <endpoint_base_directory>" << std::endl;
+                  << " <vst_plugin_dll> <endpoint_base_directory>" << std::endl
+                  << "       "
+#ifdef __i386__
+                  << yabridge_individual_host_name_32bit
+#else
+                  << yabridge_individual_host_name
+#endif
+                  << " <pool_socket>" << std::endl;
 
         return 1;
     }
 
-    const std::string plugin_dll_path(argv[1]);
-    const std::string socket_endpoint_path(argv[2]);
-
     std::cout << "Initializing yabridge host version " << yabridge_git_version
 #ifdef __i386__
               << " (32-bit compatibility mode)"
 #endif
               << std::endl;
 
+    std::string plugin_dll_path;
+    std::string socket_endpoint_path;
+    if (argc >= 3) {
+        plugin_dll_path = argv[1];
+        socket_endpoint_path = argv[2];
+    } else {
+        // Pooled mode. At this point Wine has already been brought up, which
+        // is what makes claiming this process cheap compared to a cold start.
+        // The blocking read below also doubles as a watchdog: when the pool
+        // gets torn down because the last plugin instance unloaded the
+        // library, the socket gets closed and we'll exit.
+        boost::asio::io_context pool_context{};
+        boost::asio::local::stream_protocol::socket pool_socket(pool_context);
+
+        std::cout << "Waiting for a plugin to host" << std::endl;
+        try {
+            pool_socket.connect(argv[1]);
+            write_object(pool_socket,
+                         GroupResponse{boost::this_process::get_id()});
+
+            const auto request = read_object<GroupRequest>(pool_socket);
+            plugin_dll_path = request.plugin_path;
+            socket_endpoint_path = request.endpoint_base_dir;
+        } catch (const boost::system::system_error& error) {
+            std::cerr << "The process pool has shut down, exiting:"
+                      << std::endl;
+            std::cerr << error.what() << std::endl;
+
+            return 0;
+        }
+    }
+
     // As explained in `Vst2Bridge`, the plugin has to be initialized in the
     // same thread as the one that calls `io_context.run()`. This setup is
     // slightly more convoluted than it has to be, but doing it this way we
@@ -90,10 +140,12 @@ int __cdecl main(int argc, char* argv[]) {
     });
 
     // Handle Win32 messages and X11 events on a timer, just like in
-    // `GroupBridge::async_handle_events()``
+    // `GroupBridge::async_handle_events()`. The loop drops to a slow
+    // heartbeat when the editor is closed and the message loop has gone
+    // quiet.
     main_context.async_handle_events([&]() {
         bridge->handle_x11_events();
-        bridge->handle_win32_events();
+        return bridge->handle_win32_events();
     });
     main_context.run();
 }
@@ -32,13 +32,34 @@
 #include <function2/function2.hpp>
 
 /**
- * The delay between calls to the event loop so we can keep a nice 60 fps. We
- * could bump this up to the monitor's refresh rate, but I'm afraid that it will
- * start to noticeably take up resources in plugin groups.
+ * The delay between calls to the event loop while there's GUI work to do, so
+ * we can keep a nice 60 fps. We could bump this up to the monitor's refresh
+ * rate, but I'm afraid that it will start to noticeably take up resources in
+ * plugin groups.
  */
 constexpr std::chrono::duration event_loop_interval =
     std::chrono::milliseconds(1000) / 60;
 
+/**
+ * The delay between calls to the event loop while no editors are open and the
+ * message loop hasn't processed anything in a while. Without an open editor
+ * the loop only exists to serve `SetTimer()` based timers and deferred tasks,
+ * and those can tolerate much coarser polling. This keeps the idle CPU usage
+ * of a group process hosting many editor-less plugins close to zero, instead
+ * of having it wake up 60 times per second just to poll an empty queue.
+ */
+constexpr std::chrono::duration idle_event_loop_interval =
+    std::chrono::milliseconds(200);
+
+/**
+ * The number of consecutive event loop ticks without any GUI work after which
+ * the loop drops from `event_loop_interval` down to
+ * `idle_event_loop_interval`. At 60 ticks this is about a second, which is
+ * enough to not throttle plugins that are still busy deferring work right
+ * after loading.
+ */
+constexpr int event_loop_active_ticks = 60;
+
 /**
  * A wrapper around `boost::asio::io_context()` to serve as the application's
  * main IO context. A single instance is shared for all plugins in a plugin
@@ -64,18 +85,28 @@ class MainContext {
     void stop();
 
     /**
-     * Start a timer to handle events every `event_loop_interval` milliseconds.
+     * Start a timer to handle events. The loop is demand-driven: while an
+     * editor is open or while the Win32 message loop is actually retrieving
+     * messages this ticks every `event_loop_interval` to keep the GUI smooth,
+     * and after `event_loop_active_ticks` quiet ticks it drops down to the
+     * `idle_event_loop_interval` heartbeat until there's work again.
      *
      * @param handler The function that should be executed in the IO context
      *   when the timer ticks. This should be a function that handles both the
-     *   X11 events and the Win32 message loop.
+     *   X11 events and the Win32 message loop, and it should return `true`
+     *   when an editor is open or when any messages were processed so the
+     *   loop knows to keep up the full cadence.
      */
     template <typename F>
     void async_handle_events(F handler) {
+        const auto interval = remaining_active_ticks > 0
+                                  ? event_loop_interval
+                                  : idle_event_loop_interval;
+
         // Try to keep a steady framerate, but add in delays to let other events
         // get handled if the GUI message handling somehow takes very long.
         events_timer.expires_at(std::max(
-            events_timer.expiry() + event_loop_interval,
+            events_timer.expiry() + interval,
             std::chrono::steady_clock::now() + std::chrono::milliseconds(5)));
         events_timer.async_wait(
             [&, handler](const boost::system::error_code& error) {
@@ -83,7 +114,12 @@ class MainContext {
                     return;
                 }
 
-                handler();
+                if (handler()) {
+                    remaining_active_ticks = event_loop_active_ticks;
+                } else if (remaining_active_ticks > 0) {
+                    remaining_active_ticks--;
+                }
+
                 async_handle_events(handler);
             });
     }
@@ -99,6 +135,15 @@ class MainContext {
      * The timer used to periodically handle X11 events and Win32 messages.
      */
     boost::asio::steady_timer events_timer;
+
+    /**
+     * The number of ticks the event loop will keep running at the full
+     * cadence before dropping to the idle heartbeat. Reset to
+     * `event_loop_active_ticks` on every tick that did GUI work. Only
+     * accessed from the thread running the IO context. Starts out at the
+     * maximum so plugin initialization isn't throttled.
+     */
+    int remaining_active_ticks = event_loop_active_ticks;
 };
 
 /**